@@ -104,6 +104,7 @@ luaopen_skynet_memory(lua_State *L) {
 		{ "mallctl", lmallctl },
 		{ "dump", ldump },
 		{ "info", dump_mem_lua },
+		{ "peak", dump_peak_lua },
 		{ "current", lcurrent },
 		{ "dumpheap", ldumpheap },
 		{ "profactive", lprofactive },
@@ -118,6 +118,8 @@ lcallback(lua_State *L) {
 		skynet_callback(context, gL, forward_cb); //forward模式，不skynet_free
 	} else {
 		skynet_callback(context, gL, _cb);
+		// _cb never keeps the message
+		skynet_callback_borrow(context, 1);
 	}
 
 	return 0;
@@ -319,6 +321,57 @@ lredirect(lua_State *L) {
 	return send_message(L, source, 3);
 }
 
+/*
+	table addresses
+	integer type
+	integer session
+	string message
+	 lightuserdata message_ptr
+	 integer len
+ */
+static int
+lsendbatch(lua_State *L) {
+	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int n = (int)lua_rawlen(L, 1);
+	int type = luaL_checkinteger(L, 2);
+	int session = luaL_checkinteger(L, 3);
+	uint32_t *handles = lua_newuserdatauv(L, n * sizeof(uint32_t) + 1, 0);
+	int i;
+	for (i=0;i<n;i++) {
+		lua_rawgeti(L, 1, i+1);
+		handles[i] = (uint32_t)luaL_checkinteger(L, -1);
+		lua_pop(L, 1);
+	}
+	int r;
+	switch (lua_type(L, 4)) {
+	case LUA_TSTRING: {
+		size_t len = 0;
+		void * msg = (void *)lua_tolstring(L, 4, &len);
+		if (len == 0) {
+			msg = NULL;
+		}
+		r = skynet_send_batch(context, 0, handles, n, type, session, msg, len);
+		break;
+	}
+	case LUA_TLIGHTUSERDATA: {
+		void * msg = lua_touserdata(L, 4);
+		int size = luaL_checkinteger(L, 5);
+		r = skynet_send_batch(context, 0, handles, n, type | PTYPE_TAG_DONTCOPY, session, msg, size);
+		break;
+	}
+	default:
+		return luaL_error(L, "invalid param %s", lua_typename(L, lua_type(L,4)));
+	}
+	if (r < 0) {
+		// package is too large
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	lua_pushinteger(L, r);
+	return 1;
+}
+
 static int
 lerror(lua_State *L) {
 	struct skynet_context * context = lua_touserdata(L, lua_upvalueindex(1));
@@ -404,6 +457,40 @@ lnow(lua_State *L) {
 	return 1;
 }
 
+static int
+lnowms(lua_State *L) {
+	uint64_t ti = skynet_now_ms();
+	lua_pushinteger(L, ti);
+	return 1;
+}
+
+// the last stalls found by the monitor thread, oldest first
+static int
+lstall(lua_State *L) {
+	int n = 64;
+	struct skynet_stall *buffer = skynet_malloc(n * sizeof(*buffer));
+	n = skynet_stall_history(buffer, n);
+	lua_createtable(L, n, 0);
+	int i;
+	for (i=0;i<n;i++) {
+		struct skynet_stall *r = &buffer[i];
+		lua_createtable(L, 0, 5);
+		lua_pushinteger(L, r->time);
+		lua_setfield(L, -2, "time");
+		lua_pushinteger(L, r->source);
+		lua_setfield(L, -2, "source");
+		lua_pushinteger(L, r->destination);
+		lua_setfield(L, -2, "destination");
+		lua_pushinteger(L, r->duration);
+		lua_setfield(L, -2, "duration");
+		lua_pushstring(L, r->trace);
+		lua_setfield(L, -2, "trace");
+		lua_rawseti(L, -2, i+1);
+	}
+	skynet_free(buffer);
+	return 1;
+}
+
 static int
 lhpc(lua_State *L) {
 	lua_pushinteger(L, get_time());
@@ -485,6 +572,7 @@ luaopen_skynet_core(lua_State *L) {
 		{ "send" , lsend },
 		{ "genid", lgenid },
 		{ "redirect", lredirect },
+		{ "sendbatch", lsendbatch },
 		{ "command" , lcommand },
 		{ "intcommand", lintcommand },
 		{ "addresscommand", laddresscommand },
@@ -503,7 +591,9 @@ luaopen_skynet_core(lua_State *L) {
 		{ "packstring", lpackstring },
 		{ "trash" , ltrash },
 		{ "now", lnow },
+		{ "nowms", lnowms },
 		{ "hpc", lhpc },	// getHPCounter
+		{ "stall", lstall },
 		{ NULL, NULL },
 	};
 
@@ -44,7 +44,7 @@ lfreepool(lua_State *L) {
 	for (i=0;i<sz;i++) {
 		struct buffer_node *node = &pool[i];
 		if (node->msg) {
-			skynet_free(node->msg);
+			skynet_socket_recycle(node->msg, node->sz);
 			node->msg = NULL;
 		}
 	}
@@ -161,7 +161,7 @@ return_free_node(lua_State *L, int pool, struct socket_buffer *sb) {
 	lua_rawgeti(L,pool,1);
 	free_node->next = lua_touserdata(L,-1);
 	lua_pop(L,1);
-	skynet_free(free_node->msg);
+	skynet_socket_recycle(free_node->msg, free_node->sz);
 	free_node->msg = NULL;
 
 	free_node->sz = 0;
@@ -752,6 +752,8 @@ getinfo(lua_State *L, struct socket_info *si) {
 	lua_setfield(L, -2, "read");
 	lua_pushinteger(L, si->write);
 	lua_setfield(L, -2, "write");
+	lua_pushinteger(L, si->wcount);
+	lua_setfield(L, -2, "wcount");
 	lua_pushinteger(L, si->wbuffer);
 	lua_setfield(L, -2, "wbuffer");
 	lua_pushinteger(L, si->rtime);
@@ -783,6 +785,24 @@ linfo(lua_State *L) {
 	return 1;
 }
 
+static int
+lrecvpool(lua_State *L) {
+	struct socket_recvpool_stat stat;
+	skynet_socket_recvpool(&stat);
+	lua_createtable(L, 0, 5);
+	lua_pushinteger(L, stat.alloc);
+	lua_setfield(L, -2, "alloc");
+	lua_pushinteger(L, stat.reuse);
+	lua_setfield(L, -2, "reuse");
+	lua_pushinteger(L, stat.copy);
+	lua_setfield(L, -2, "copy");
+	lua_pushinteger(L, stat.recycle);
+	lua_setfield(L, -2, "recycle");
+	lua_pushinteger(L, stat.cache);
+	lua_setfield(L, -2, "cache");
+	return 1;
+}
+
 LUAMOD_API int
 luaopen_skynet_socketdriver(lua_State *L) {
 	luaL_checkversion(L);
@@ -797,6 +817,7 @@ luaopen_skynet_socketdriver(lua_State *L) {
 		{ "str2p", lstr2p },
 		{ "header", lheader },
 		{ "info", linfo },
+		{ "recvpool", lrecvpool },
 
 		{ "unpack", lunpack },
 		{ NULL, NULL },
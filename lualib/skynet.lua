@@ -175,7 +175,11 @@ do ---- request/select
 			self._request = 0
 		end
 		if self._timeout then
-			session_id_coroutine[self._timeout] = "BREAK"
+			if c.intcommand("CANCEL", self._timeout) then
+				session_id_coroutine[self._timeout] = nil
+			else
+				session_id_coroutine[self._timeout] = "BREAK"
+			end
 			self._timeout = nil
 		end
 	end
@@ -356,9 +360,9 @@ local timeout_traceback
 function skynet.trace_timeout(on)
 	local function trace_coroutine(func, ti)
 		local co
-		co = co_create(function()
+		co = co_create(function(...)
 			timeout_traceback[co] = nil
-			func()
+			func(...)
 		end)
 		local info = string.format("TIMER %d+%d : ", skynet.now(), ti)
 		timeout_traceback[co] = traceback(info, 3)
@@ -375,14 +379,49 @@ end
 
 skynet.trace_timeout(false)	-- turn off by default
 
---让框架在 ti 个单位时间后，调用 func 这个函数
-function skynet.timeout(ti, func)
-	local session = c.intcommand("TIMEOUT",ti)
+local timeout_cancel = {}	-- resume a cancelled timeout coroutine with it, so it goes back to the pool without calling func
+
+local function new_timeout(session, func, ti)
 	assert(session)
-	local co = co_create_for_timeout(func, ti)
+	local co = co_create_for_timeout(function(cancel)
+		if cancel ~= timeout_cancel then
+			func()
+		end
+	end, ti)
 	assert(session_id_coroutine[session] == nil)
 	session_id_coroutine[session] = co
-	return co	-- for debug
+	return session
+end
+
+--让框架在 ti 个单位时间后，调用 func 这个函数，返回 timer id，可以用 skynet.canceltimeout 取消
+function skynet.timeout(ti, func)
+	return new_timeout(c.intcommand("TIMEOUT",ti), func, ti)
+end
+
+--同 skynet.timeout，单位毫秒，精度是 config 里的 timer_resolution
+function skynet.timeoutms(ms, func)
+	return new_timeout(c.intcommand("TIMEOUTMS",ms), func, ms)
+end
+
+--取消 skynet.timeout 返回的 timer，func 不会再被调用，返回 false 表示已经执行过了
+function skynet.canceltimeout(id)
+	local co = session_id_coroutine[id]
+	if type(co) ~= "thread" then
+		return false
+	end
+	if c.intcommand("CANCEL", id) then
+		session_id_coroutine[id] = nil
+	else
+		-- already fired, the response is in the message queue
+		session_id_coroutine[id] = "BREAK"
+	end
+	if timeout_traceback then
+		timeout_traceback[co] = nil
+	end
+	local running = running_thread
+	coroutine_resume(co, timeout_cancel)
+	running_thread = running
+	return true
 end
 
 --休眠挂起
@@ -396,9 +435,7 @@ local function suspend_sleep(session, token)
 	return coroutine_yield "SUSPEND" --挂起,返回"SUSPEND"给resume,最终在suspend唤醒其他wait协程
 end
 
--- 将当前 coroutine 挂起 ti 个单位时间。
-function skynet.sleep(ti, token)
-	local session = c.intcommand("TIMEOUT",ti)
+local function sleep_timer(session, token)
 	assert(session)
 	token = token or coroutine.running()
 	local succ, ret = suspend_sleep(session, token) --dispatch_wakeup唤醒返回false, "BREAK"
@@ -407,12 +444,26 @@ function skynet.sleep(ti, token)
 		return
 	end
 	if ret == "BREAK" then
+		-- woken up before the timer expires, drop the timer
+		if c.intcommand("CANCEL", session) then
+			session_id_coroutine[session] = nil
+		end
 		return "BREAK"
 	else
 		error(ret)
 	end
 end
 
+-- 将当前 coroutine 挂起 ti 个单位时间。
+function skynet.sleep(ti, token)
+	return sleep_timer(c.intcommand("TIMEOUT",ti), token)
+end
+
+-- 同 skynet.sleep，单位毫秒
+function skynet.sleepms(ms, token)
+	return sleep_timer(c.intcommand("TIMEOUTMS",ms), token)
+end
+
 --交出当前服务对 CPU 的控制权。通常在你想做大量的操作，又没有机会调用阻塞 API 时，可以选择调用 yield 让系统跑的更平滑。
 function skynet.yield()
 	return skynet.sleep(0)
@@ -493,6 +544,7 @@ function skynet.localname(name)
 end
 
 skynet.now = c.now
+skynet.nowms = c.nowms	-- in millisecond, as precise as timer_resolution
 skynet.hpc = c.hpc	-- high performance counter
 
 local traceid = 0
@@ -590,6 +642,12 @@ function skynet.send(addr, typename, ...)
 	return c.send(addr, p.id, 0 , p.pack(...))
 end
 
+--向一组服务(地址数组)发送同一条消息，只打包一次，消息体由接收者共享，返回发出的服务数
+function skynet.sendbatch(addrs, typename, ...)
+	local p = proto[typename]
+	return c.sendbatch(addrs, p.id, 0, p.pack(...))
+end
+
 --和 skynet.send 类似。但发送时不经过 pack 打包流程
 function skynet.rawsend(addr, typename, msg, sz)
 	local p = proto[typename]
@@ -1109,10 +1167,10 @@ end
 -- 当 init_service pcall fail 的时候将调用 err_func
 function skynet.start(start_func, err_func)
 	c.callback(skynet.dispatch_message)
-	init_thread = skynet.timeout(0, function()
+	init_thread = session_id_coroutine[skynet.timeout(0, function()
 		skynet.init_service(start_func, err_func)
 		init_thread = nil
-	end)
+	end)]
 end
 
 --获取服务是否是死循环
@@ -1126,6 +1184,7 @@ function skynet.mqlen()
 end
 
 --"mqlen","endless","cpu"占用时间,"time"运行时长,"message"处理派发的消息总数
+--"mqlen_high","mqlen_normal" 高优先级(回应/系统/错误消息)和普通通道的队列长度,"mqdrop" 邮箱满了丢掉的消息数
 function skynet.stat(what)
 	return c.intcommand("STAT", what)
 end
@@ -1,5 +1,65 @@
 local table = table
 local extern_dbgcmd = {}
+local c = require "skynet.core"
+
+-- the histograms are bucketed by power of 2 in microsec, return the upper bound of the bucket
+local function percentile(hist, count, p)
+	local n = math.ceil(count * p)
+	local total = 0
+	for i = 0, 31 do	-- STAT_BUCKETS - 1
+		total = total + (hist[i] or 0)
+		if total >= n then
+			return 1 << i
+		end
+	end
+end
+
+local function parse_hist(str, hist)
+	if str ~= "-" then
+		for b, n in str:gmatch "(%d+):(%d+)" do
+			b = tonumber(b)
+			hist[b] = (hist[b] or 0) + tonumber(n)
+		end
+	end
+	return hist
+end
+
+-- see skynet_stat_dump in skynet_stat.c
+local function latency()
+	local result = {}
+	for t, count, wsum, csum, wait, cb in c.command("STAT", "latency"):gmatch "(%d+) (%d+) (%d+) (%d+) (%S+) (%S+)\n" do
+		result[tonumber(t)] = {
+			count = tonumber(count),
+			wait_sum = tonumber(wsum),
+			cb_sum = tonumber(csum),
+			wait = parse_hist(wait, {}),
+			cb = parse_hist(cb, {}),
+		}
+	end
+	return result
+end
+
+local function summary(item)
+	local n = item.count
+	local function max(hist)
+		local m = 0
+		for i in pairs(hist) do
+			m = math.max(m, i)
+		end
+		return 1 << m
+	end
+	return {
+		count = n,
+		wait_avg = item.wait_sum // n,
+		wait_p50 = percentile(item.wait, n, 0.5),
+		wait_p99 = percentile(item.wait, n, 0.99),
+		wait_max = max(item.wait),
+		cb_avg = item.cb_sum // n,
+		cb_p50 = percentile(item.cb, n, 0.5),
+		cb_p99 = percentile(item.cb, n, 0.99),
+		cb_max = max(item.cb),
+	}
+end
 
 local function init(skynet, export)
 	local internal_info_func
@@ -39,11 +99,56 @@ local function init(skynet, export)
 			local stat = {}
 			stat.task = skynet.task()
 			stat.mqlen = skynet.stat "mqlen"
+			stat.mqhigh = skynet.stat "mqlen_high"
+			stat.mqdrop = skynet.stat "mqdrop"
 			stat.cpu = skynet.stat "cpu"
 			stat.message = skynet.stat "message"
+			-- all the message types, in microsec
+			local all = { count = 0, wait_sum = 0, cb_sum = 0, wait = {}, cb = {} }
+			for _, item in pairs(latency()) do
+				all.count = all.count + item.count
+				for i, n in pairs(item.wait) do
+					all.wait[i] = (all.wait[i] or 0) + n
+				end
+				for i, n in pairs(item.cb) do
+					all.cb[i] = (all.cb[i] or 0) + n
+				end
+			end
+			if all.count > 0 then
+				stat.wait_p99 = percentile(all.wait, all.count, 0.99)
+				stat.cb_p99 = percentile(all.cb, all.count, 0.99)
+			end
 			skynet.ret(skynet.pack(stat))
 		end
 
+		-- queue wait and callback time of each message type, in microsec
+		function dbgcmd.LATENCY()
+			local names = {}
+			for k, v in pairs(skynet) do
+				if type(k) == "string" and k:find "^PTYPE_" then
+					names[v] = k:sub(7):lower()
+				end
+			end
+			local result = {}
+			for t, item in pairs(latency()) do
+				local name = names[t] or tostring(t)
+				if t == 15 then
+					name = ">=15"	-- STAT_TYPES - 1
+				end
+				result[name] = summary(item)
+			end
+			skynet.ret(skynet.pack(result))
+		end
+
+		-- sample the running lua stacks for sec seconds, return the collapsed stacks for flamegraph tools
+		-- (a coroutine with a hook of debug.sethook is not sampled)
+		function dbgcmd.PROFILE(sec, hz, period)
+			local profile = require "skynet.profile"
+			profile.sample_start(hz, period)
+			skynet.sleep(math.floor((sec or 10) * 100))
+			skynet.ret(skynet.pack(profile.sample_stop()))
+		end
+
 		function dbgcmd.KILLTASK(threadname)
 			local co = skynet.killthread(threadname)
 			if co then
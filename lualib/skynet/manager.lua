@@ -86,6 +86,21 @@ function skynet.filter(f ,start_func)
 	end)
 end
 
+--限制服务邮箱(普通通道)的长度，limit 为 0 取消限制，服务启动时可以对 skynet.self() 调用
+--policy : "reject" 拒绝新消息(默认) "dropold" 挤掉最老的消息 "shed" 只拒绝后面列出类型的消息，如 "socket" 或 skynet.PTYPE_CLIENT
+--被丢掉的消息如果是 call 请求，发送方会收到错误
+function skynet.mailbox(addr, limit, policy, ...)
+	local types = {}
+	for i, t in ipairs {...} do
+		if type(t) == "string" then
+			t = assert(skynet["PTYPE_" .. t:upper()], t)
+		end
+		types[i] = tostring(t)
+	end
+	local param = string.format("%s %d %s %s", skynet.address(addr or skynet.self()), limit, policy or "reject", table.concat(types, " "))
+	c.command("MAILBOX", param)
+end
+
 --给当前 skynet 进程设置一个全局的服务退出时的监控。
 function skynet.monitor(service, query)
 	local monitor
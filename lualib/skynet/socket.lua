@@ -476,6 +476,7 @@ end
 socket.sendto = assert(driver.udp_send)
 socket.udp_address = assert(driver.udp_address)
 socket.netstat = assert(driver.info)
+socket.recvpool = assert(driver.recvpool)
 
 function socket.warning(id, callback)
 	local obj = socket_pool[id]
@@ -5,6 +5,8 @@
 #include <string.h>
 #include <assert.h>
 
+#include "skynet_socket.h"
+
 #define MESSAGEPOOL 1023
 
 struct message {
@@ -54,7 +56,7 @@ _return_message(struct databuffer *db, struct messagepool *mp) {
 	} else {
 		db->head = m->next;
 	}
-	skynet_free(m->buffer);
+	skynet_socket_recycle(m->buffer, m->size);	// m->buffer is the data of a socket message
 	m->buffer = NULL;
 	m->size = 0;
 	m->next = mp->freelist;
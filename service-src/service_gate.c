@@ -225,7 +225,7 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 		} else {
 			skynet_error(ctx, "Drop unknown connection %d message", message->id);
 			skynet_socket_close(ctx, message->id);
-			skynet_free(message->buffer);
+			skynet_socket_recycle(message->buffer, message->ud);
 		}
 		break;
 	}
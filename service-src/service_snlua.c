@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <pthread.h>
 
 #if defined(__APPLE__)
 #include <mach/task.h>
@@ -31,6 +32,10 @@ struct snlua {
 	size_t mem_limit; // ڴ
 	lua_State * activeL;
 	ATOM_INT trap;
+	ATOM_INT trace;	// signal 2 : the trap captures a traceback instead of raising an error
+	struct sampler * sampler;	// not NULL when profile.sample_start()
+	int prepared;	// prepare_state() is done by the prewarm thread
+	struct arena * arena;	// NULL : skynet_lalloc
 };
 
 // LUA_CACHELIB may defined in patched lua for shared proto
@@ -60,21 +65,248 @@ codecache(lua_State *L) {
 
 #endif
 
+// sampling profiler
+// A count hook checks the clock every `period` instructions, and folds the running stack into
+// a hash table once per `interval` nanosec of running time. Only the time lua runs in this service
+// is sampled, the time spent in one C function is charged to one sample at most.
+
+#define SAMPLE_HZ 100
+#define SAMPLE_PERIOD 1000
+#define SAMPLE_DEPTH 64
+#define SAMPLE_FRAME 128
+
+struct sample_stack {
+	uint32_t hash;
+	int count;
+	size_t sz;
+	char * stack;
+};
+
+struct sampler {
+	uint64_t interval;
+	uint64_t elapsed;
+	uint64_t last;
+	int period;
+	int samples;
+	int cap;
+	int n;
+	struct sample_stack * slot;
+	char buffer[SAMPLE_DEPTH * SAMPLE_FRAME];
+};
+
+static uint64_t
+sample_clock() {
+	struct timespec ti;
+	clock_gettime(CLOCK_MONOTONIC, &ti);
+	return (uint64_t)ti.tv_sec * NANOSEC + ti.tv_nsec;
+}
+
+static struct sampler *
+sampler_new(int hz, int period) {
+	struct sampler * s = skynet_malloc(sizeof(*s));
+	memset(s, 0, sizeof(*s));
+	s->interval = NANOSEC / hz;
+	s->period = period;
+	s->last = sample_clock();
+	s->cap = 64;
+	s->slot = skynet_malloc(s->cap * sizeof(struct sample_stack));
+	memset(s->slot, 0, s->cap * sizeof(struct sample_stack));
+	return s;
+}
+
+static void
+sampler_delete(struct sampler *s) {
+	int i;
+	for (i=0;i<s->cap;i++) {
+		skynet_free(s->slot[i].stack);
+	}
+	skynet_free(s->slot);
+	skynet_free(s);
+}
+
+static uint32_t
+sample_hash(const char *str, size_t sz) {
+	uint32_t h = 2166136261u;	// FNV-1a
+	size_t i;
+	for (i=0;i<sz;i++) {
+		h = (h ^ (uint8_t)str[i]) * 16777619u;
+	}
+	return h;
+}
+
+static struct sample_stack *
+sample_slot(struct sample_stack *slot, int cap, uint32_t hash, const char *stack, size_t sz) {
+	int i = hash & (cap - 1);
+	for (;;) {
+		struct sample_stack *ss = &slot[i];
+		if (ss->stack == NULL || (ss->hash == hash && ss->sz == sz && memcmp(ss->stack, stack, sz) == 0)) {
+			return ss;
+		}
+		i = (i + 1) & (cap - 1);
+	}
+}
+
+static void
+sample_rehash(struct sampler *s) {
+	int cap = s->cap * 2;
+	struct sample_stack * slot = skynet_malloc(cap * sizeof(struct sample_stack));
+	memset(slot, 0, cap * sizeof(struct sample_stack));
+	int i;
+	for (i=0;i<s->cap;i++) {
+		struct sample_stack *ss = &s->slot[i];
+		if (ss->stack) {
+			*sample_slot(slot, cap, ss->hash, ss->stack, ss->sz) = *ss;
+		}
+	}
+	skynet_free(s->slot);
+	s->slot = slot;
+	s->cap = cap;
+}
+
+static int
+sample_frame(lua_State *L, lua_Debug *ar, char *buf) {
+	lua_getinfo(L, "Sn", ar);
+	const char * name = ar->name ? ar->name : "?";
+	int n;
+	if (*ar->what == 'C') {
+		n = snprintf(buf, SAMPLE_FRAME, "[C]%s", name);
+	} else if (*ar->what == 'm') {
+		n = snprintf(buf, SAMPLE_FRAME, "main@%s", ar->short_src);
+	} else {
+		n = snprintf(buf, SAMPLE_FRAME, "%s@%s:%d", name, ar->short_src, ar->linedefined);
+	}
+	if (n >= SAMPLE_FRAME)
+		n = SAMPLE_FRAME - 1;
+	int i;
+	for (i=0;i<n;i++) {
+		if (buf[i] == ';')	// frame separator of the collapsed stack
+			buf[i] = ':';
+	}
+	return n;
+}
+
+// fold the stack of L into "root;caller;callee", the format of the flamegraph tools
+static void
+sample_stack(struct sampler *s, lua_State *L) {
+	lua_Debug ar;
+	int depth = 0;
+	while (depth < SAMPLE_DEPTH && lua_getstack(L, depth, &ar))
+		++depth;
+	if (depth == 0)
+		return;
+	char * buf = s->buffer;
+	size_t sz = 0;
+	if (depth == SAMPLE_DEPTH && lua_getstack(L, depth, &ar)) {
+		// too deep, keep the innermost frames
+		memcpy(buf, "...", 3);
+		sz = 3;
+	}
+	int level;
+	for (level = depth - 1; level >= 0; level--) {
+		if (sz > 0)
+			buf[sz++] = ';';
+		lua_getstack(L, level, &ar);
+		sz += sample_frame(L, &ar, buf + sz);
+	}
+	uint32_t hash = sample_hash(buf, sz);
+	struct sample_stack *ss = sample_slot(s->slot, s->cap, hash, buf, sz);
+	if (ss->stack == NULL) {
+		ss->hash = hash;
+		ss->sz = sz;
+		ss->stack = skynet_malloc(sz);
+		memcpy(ss->stack, buf, sz);
+		if (++s->n * 4 >= s->cap * 3) {
+			sample_rehash(s);
+			ss = sample_slot(s->slot, s->cap, hash, buf, sz);
+		}
+	}
+	++ss->count;
+	++s->samples;
+}
+
+static void
+sample_charge(struct sampler *s) {
+	uint64_t now = sample_clock();
+	uint64_t elapsed = now - s->last;
+	s->last = now;
+	if (elapsed > s->interval) {
+		// a long C function, or the service was idle since the last mark
+		elapsed = s->interval;
+	}
+	s->elapsed += elapsed;
+}
+
+static void
+sample_hook(lua_State *L, lua_Debug *ar) {
+	void *ud = NULL;
+	lua_getallocf(L, &ud);
+	struct snlua *l = (struct snlua *)ud;
+	struct sampler *s = l->sampler;
+	if (s == NULL) {
+		// stopped, the hook of this coroutine is left
+		lua_sethook(L, NULL, 0, 0);
+		return;
+	}
+	sample_charge(s);
+	if (s->elapsed >= s->interval) {
+		s->elapsed -= s->interval;
+		sample_stack(s, L);
+	}
+}
+
+static void
+reset_hook(lua_State *L, struct snlua *l) {
+	if (l->sampler) {
+		lua_sethook(L, sample_hook, LUA_MASKCOUNT, l->sampler->period);
+	} else {
+		lua_sethook(L, NULL, 0, 0);
+	}
+}
+
+// set or clear the sample_hook of a coroutine, a hook of its own (debug.sethook by a debugger, a coverage tool ...)
+// is left alone, so that coroutine is not sampled
+static void
+sync_hook(lua_State *L, struct snlua *l) {
+	lua_Hook hook = lua_gethook(L);
+	if (l->sampler) {
+		// lua_sethook restarts the instruction count, so leave a sample_hook already in place alone,
+		// or a coroutine that runs less than a period each resume is never sampled
+		if (hook == NULL || (hook == sample_hook && lua_gethookcount(L) != l->sampler->period)) {
+			lua_sethook(L, sample_hook, LUA_MASKCOUNT, l->sampler->period);
+		}
+	} else if (hook == sample_hook) {
+		lua_sethook(L, NULL, 0, 0);
+	}
+}
+
 static void
 signal_hook(lua_State *L, lua_Debug *ar) {
 	void *ud = NULL;
 	lua_getallocf(L, &ud);
 	struct snlua *l = (struct snlua *)ud;
 
-	lua_sethook (L, NULL, 0, 0);
+	reset_hook(L, l);
 	if (ATOM_LOAD(&l->trap)) {
 		ATOM_STORE(&l->trap , 0);
+		if (ATOM_LOAD(&l->trace)) {
+			ATOM_STORE(&l->trace, 0);
+			// report where it is and go on
+			luaL_traceback(L, L, "stall", 0);
+			const char * trace = lua_tostring(L, -1);
+			if (skynet_stall_traceback(l->ctx, trace)) {
+				skynet_error(l->ctx, "%s", trace);
+			}
+			lua_pop(L, 1);
+			return;
+		}
 		luaL_error(L, "signal 0");
 	}
 }
 
 static void
 switchL(lua_State *L, struct snlua *l) {
+	// the hook is per coroutine, set it before activeL, so it never overrides the signal_hook of set_trap
+	sync_hook(L, l);
 	l->activeL = L;
 	if (ATOM_LOAD(&l->trap)) {
 		lua_sethook(L, signal_hook, LUA_MASKCOUNT, 1);
@@ -87,12 +319,24 @@ lua_resumeX(lua_State *L, lua_State *from, int nargs, int *nresults) {
 	lua_getallocf(L, &ud);
 	struct snlua *l = (struct snlua *)ud;
 	switchL(L, l);
+	if (l->sampler) {
+		if (from == l->L) {
+			// don't charge the time before a resume from the main thread (the service may be idle)
+			l->sampler->last = sample_clock();
+		} else {
+			sample_charge(l->sampler);
+		}
+	}
 	int err = lua_resume(L, from, nargs, nresults);
 	if (ATOM_LOAD(&l->trap)) {
 		// wait for lua_sethook. (l->trap == -1)
 		while (ATOM_LOAD(&l->trap) >= 0) ;
 	}
 	switchL(from, l);
+	if (l->sampler) {
+		// a coroutine often yields before its hook count runs out, keep its time for the next hook
+		sample_charge(l->sampler);
+	}
 	return err;
 }
 
@@ -325,11 +569,77 @@ lstop(lua_State *L) {
 	return 1;
 }
 
+static struct snlua *
+get_snlua(lua_State *L) {
+	void *ud = NULL;
+	lua_getallocf(L, &ud);
+	return (struct snlua *)ud;
+}
+
+static int
+lsample_start(lua_State *L) {
+	int hz = luaL_optinteger(L, 1, SAMPLE_HZ);
+	int period = luaL_optinteger(L, 2, SAMPLE_PERIOD);
+	luaL_argcheck(L, hz > 0 && hz <= 10000, 1, "sample frequency should be in [1, 10000]");
+	luaL_argcheck(L, period > 0, 2, "instruction period should be positive");
+	struct snlua *l = get_snlua(L);
+	if (l->sampler) {
+		return luaL_error(L, "Sampling is already started");
+	}
+	l->sampler = sampler_new(hz, period);
+	// other coroutines set the hook in switchL
+	sync_hook(L, l);
+	return 0;
+}
+
+static int
+sample_compar(const void *a, const void *b) {
+	const struct sample_stack *sa = *(const struct sample_stack **)a;
+	const struct sample_stack *sb = *(const struct sample_stack **)b;
+	return sb->count - sa->count;
+}
+
+// return collapsed stacks ( "stack count\n" each line, sorted by count ) and the number of samples
+static int
+lsample_stop(lua_State *L) {
+	struct snlua *l = get_snlua(L);
+	struct sampler *s = l->sampler;
+	if (s == NULL) {
+		return luaL_error(L, "Call profile.sample_start() before profile.sample_stop()");
+	}
+	l->sampler = NULL;
+	sync_hook(L, l);
+
+	struct sample_stack ** list = skynet_malloc((s->n + 1) * sizeof(struct sample_stack *));
+	int i, n = 0;
+	for (i=0;i<s->cap;i++) {
+		if (s->slot[i].stack)
+			list[n++] = &s->slot[i];
+	}
+	qsort(list, n, sizeof(struct sample_stack *), sample_compar);
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	for (i=0;i<n;i++) {
+		luaL_addlstring(&b, list[i]->stack, list[i]->sz);
+		char tmp[32];
+		int sz = snprintf(tmp, sizeof(tmp), " %d\n", list[i]->count);
+		luaL_addlstring(&b, tmp, sz);
+	}
+	skynet_free(list);
+	int samples = s->samples;
+	sampler_delete(s);
+	luaL_pushresult(&b);
+	lua_pushinteger(L, samples);
+	return 2;
+}
+
 static int
 init_profile(lua_State *L) {
 	luaL_Reg l[] = {
 		{ "start", lstart },
 		{ "stop", lstop },
+		{ "sample_start", lsample_start },
+		{ "sample_stop", lsample_stop },
 		{ "resume", luaB_coresume },
 		{ "wrap", luaB_cowrap },
 		{ NULL, NULL },
@@ -379,10 +689,28 @@ optstring(struct skynet_context *ctx, const char *key, const char * str) {
 	return ret;
 }
 
+struct snlua_env {
+	const char * path;
+	const char * cpath;
+	const char * service;
+	const char * preload;
+	const char * loader;
+};
+
+static void
+snlua_getenv(struct skynet_context *ctx, struct snlua_env *env) {
+	env->path = optstring(ctx, "lua_path","./lualib/?.lua;./lualib/?/init.lua");
+	env->cpath = optstring(ctx, "lua_cpath","./luaclib/?.so");
+	env->service = optstring(ctx, "luaservice", "./service/?.lua");
+	env->preload = skynet_command(ctx, "GETENV", "preload");
+	env->loader = optstring(ctx, "lualoader", "./lualib/loader.lua");
+}
+
+// the part of init_cb without skynet_context, it runs ahead in the prewarm thread when snlua_pool is set.
+// leave traceback and the compiled loader on the stack, or the error message when it fails.
 static int
-init_cb(struct snlua *l, struct skynet_context *ctx, const char * args, size_t sz) {
+prepare_state(struct snlua *l, const struct snlua_env *env) {
 	lua_State *L = l->L;
-	l->ctx = ctx;
 	lua_gc(L, LUA_GCSTOP, 0); // ֹͣռ
 	lua_pushboolean(L, 1);  /* signal for libraries to ignore env. vars. */
 	lua_setfield(L, LUA_REGISTRYINDEX, "LUA_NOENV"); // üLUA_NOENVֵΪtrueԻ
@@ -399,42 +727,48 @@ init_cb(struct snlua *l, struct skynet_context *ctx, const char * args, size_t s
 
 	lua_settop(L, profile_lib-1);
 
-	lua_pushlightuserdata(L, ctx);
-	lua_setfield(L, LUA_REGISTRYINDEX, "skynet_context"); // üskynet_contextֵΪctx
 	luaL_requiref(L, "skynet.codecache", codecache , 0); // skynet.codecache = luaopen_cache
 	lua_pop(L,1);
 
 	lua_gc(L, LUA_GCGEN, 0, 0);
 
-	const char *path = optstring(ctx, "lua_path","./lualib/?.lua;./lualib/?/init.lua");
-	lua_pushstring(L, path);
+	lua_pushstring(L, env->path);
 	lua_setglobal(L, "LUA_PATH");
-	const char *cpath = optstring(ctx, "lua_cpath","./luaclib/?.so");
-	lua_pushstring(L, cpath);
+	lua_pushstring(L, env->cpath);
 	lua_setglobal(L, "LUA_CPATH");
-	const char *service = optstring(ctx, "luaservice", "./service/?.lua");
-	lua_pushstring(L, service);
+	lua_pushstring(L, env->service);
 	lua_setglobal(L, "LUA_SERVICE");
-	const char *preload = skynet_command(ctx, "GETENV", "preload");
-	lua_pushstring(L, preload);
+	lua_pushstring(L, env->preload);
 	lua_setglobal(L, "LUA_PRELOAD");
 
 	lua_pushcfunction(L, traceback); // traceback Cѹջ,lua functionѹջʱtraceback Cⱨ
 	assert(lua_gettop(L) == 1);
 
-	const char * loader = optstring(ctx, "lualoader", "./lualib/loader.lua");
-
 	// loader.luaѹջ
-	int r = luaL_loadfile(L,loader);
-	if (r != LUA_OK) {
-		skynet_error(ctx, "Can't load %s : %s", loader, lua_tostring(L, -1)); // errorϢlogger
-		report_launcher_error(ctx); // .launcher״̬쳣.launcher
-		return 1;
+	return luaL_loadfile(L, env->loader);
+}
+
+static int
+init_cb(struct snlua *l, struct skynet_context *ctx, const char * args, size_t sz) {
+	lua_State *L = l->L;
+	l->ctx = ctx;
+	if (!l->prepared) {
+		struct snlua_env env;
+		snlua_getenv(ctx, &env);
+		if (prepare_state(l, &env) != LUA_OK) {
+			skynet_error(ctx, "Can't load %s : %s", env.loader, lua_tostring(L, -1)); // errorϢlogger
+			report_launcher_error(ctx); // .launcher״̬쳣.launcher
+			return 1;
+		}
 	}
+
+	lua_pushlightuserdata(L, ctx);
+	lua_setfield(L, LUA_REGISTRYINDEX, "skynet_context"); // üskynet_contextֵΪctx
+
 	// ѹlua
 	lua_pushlstring(L, args, sz);
 	// ִloader.luamain
-	r = lua_pcall(L,1,0,1);
+	int r = lua_pcall(L,1,0,1);
 	if (r != LUA_OK) {
 		skynet_error(ctx, "lua loader error : %s", lua_tostring(L, -1));
 		report_launcher_error(ctx);
@@ -468,9 +802,22 @@ launch_cb(struct skynet_context * context, void *ud, int type, int session, uint
 	return 0;
 }
 
-//args Ϣ
+static void snlua_setup(struct skynet_context *ctx);
+static void snlua_rebuild(struct snlua *l, int arena);
+static int ARENA_DEFAULT = 0;	// snlua_arena in config
+
+//args Ϣ "-arena name ..." Ϊѡ arena 
 int
 snlua_init(struct snlua *l, struct skynet_context *ctx, const char * args) {
+	snlua_setup(ctx);
+	int arena = ARENA_DEFAULT;
+	if (strncmp(args, "-arena ", 7) == 0) {
+		arena = 1;
+		args += 7;
+	}
+	if ((l->arena != NULL) != arena) {
+		snlua_rebuild(l, arena);
+	}
 	int sz = strlen(args);
 	char * tmp = skynet_malloc(sz);
 	memcpy(tmp, args, sz);
@@ -482,6 +829,107 @@ snlua_init(struct snlua *l, struct skynet_context *ctx, const char * args) {
 	return 0;
 }
 
+// arena : lua objects up to ARENA_MAXSIZE bytes are carved from ARENA_CHUNK chunks by size class,
+// a freed block goes to the free list of its class, and all the chunks are released at once when the service exits.
+// the bigger ones go to skynet_lalloc. lua passes the block size to the allocator, so no header is needed.
+
+#define ARENA_ALIGN 16
+#define ARENA_MAXSIZE 512
+#define ARENA_CLASS (ARENA_MAXSIZE / ARENA_ALIGN)
+#define ARENA_CHUNK (64 * 1024)
+
+struct arena {
+	void * freelist[ARENA_CLASS];
+	void * chunk;	// the first pointer of a chunk links the next one
+	char * ptr;
+	char * end;
+	int chunks;
+	int closing;
+};
+
+static struct arena *
+arena_new(void) {
+	struct arena * a = skynet_malloc(sizeof(*a));
+	memset(a, 0, sizeof(*a));
+	return a;
+}
+
+static void
+arena_delete(struct arena *a) {
+	void * chunk = a->chunk;
+	while (chunk) {
+		void * next = *(void **)chunk;
+		skynet_lalloc(chunk, ARENA_CHUNK, 0);
+		chunk = next;
+	}
+	skynet_free(a);
+}
+
+static inline int
+arena_class(size_t sz) {
+	return (sz - 1) / ARENA_ALIGN;
+}
+
+static void *
+arena_alloc(struct arena *a, size_t sz) {
+	int c = arena_class(sz);
+	void * p = a->freelist[c];
+	if (p) {
+		a->freelist[c] = *(void **)p;
+		return p;
+	}
+	sz = (c + 1) * ARENA_ALIGN;
+	if (a->ptr + sz > a->end) {
+		char * chunk = skynet_lalloc(NULL, 0, ARENA_CHUNK);
+		if (chunk == NULL)
+			return NULL;
+		*(void **)chunk = a->chunk;
+		a->chunk = chunk;
+		++a->chunks;
+		// keep the blocks aligned as malloc does
+		a->ptr = chunk + ARENA_ALIGN;
+		a->end = chunk + ARENA_CHUNK;
+	}
+	p = a->ptr;
+	a->ptr += sz;
+	return p;
+}
+
+static inline void
+arena_free(struct arena *a, void *p, size_t sz) {
+	if (a->closing)	// lua_close, the chunks will be released
+		return;
+	int c = arena_class(sz);
+	*(void **)p = a->freelist[c];
+	a->freelist[c] = p;
+}
+
+static void *
+arena_lalloc(struct arena *a, void *ptr, size_t osize, size_t nsize) {
+	if (ptr == NULL)
+		osize = 0;	// osize is the type of the object
+	if (nsize == 0) {
+		if (osize > ARENA_MAXSIZE)
+			skynet_lalloc(ptr, osize, 0);
+		else if (ptr)
+			arena_free(a, ptr, osize);
+		return NULL;
+	}
+	if (osize > ARENA_MAXSIZE && nsize > ARENA_MAXSIZE)
+		return skynet_lalloc(ptr, osize, nsize);
+	if (ptr && osize <= ARENA_MAXSIZE && nsize <= ARENA_MAXSIZE && arena_class(osize) == arena_class(nsize))
+		return ptr;
+	void * p = nsize > ARENA_MAXSIZE ? skynet_lalloc(NULL, 0, nsize) : arena_alloc(a, nsize);
+	if (p == NULL || ptr == NULL)
+		return p;
+	memcpy(p, ptr, osize < nsize ? osize : nsize);
+	if (osize > ARENA_MAXSIZE)
+		skynet_lalloc(ptr, osize, 0);
+	else
+		arena_free(a, ptr, osize);
+	return p;
+}
+
 static void *
 lalloc(void * ud, void *ptr, size_t osize, size_t nsize) {
 	struct snlua *l = ud;
@@ -499,42 +947,202 @@ lalloc(void * ud, void *ptr, size_t osize, size_t nsize) {
 		l->mem_report *= 2;
 		skynet_error(l->ctx, "Memory warning %.2f M", (float)l->mem / (1024 * 1024));
 	}
+	if (l->arena)
+		return arena_lalloc(l->arena, ptr, osize, nsize);
 	return skynet_lalloc(ptr, osize, nsize);
 }
 
-struct snlua *
-snlua_create(void) {
+static void
+snlua_close(struct snlua *l) {
+	if (l->arena) {
+		l->arena->closing = 1;
+		lua_close(l->L);
+		arena_delete(l->arena);
+		l->arena = NULL;
+	} else {
+		lua_close(l->L);
+	}
+}
+
+static struct snlua *
+snlua_new(int arena) {
 	struct snlua * l = skynet_malloc(sizeof(*l));
 	memset(l,0,sizeof(*l));
 	l->mem_report = MEMORY_WARNING_REPORT;
 	l->mem_limit = 0;
+	l->arena = arena ? arena_new() : NULL;
 	l->L = lua_newstate(lalloc, l);
-	l->activeL = NULL;
+	l->activeL = l->L;	// the main thread runs before any coroutine, signal may come at any time
 	ATOM_INIT(&l->trap , 0);
+	ATOM_INIT(&l->trace , 0);
 	return l;
 }
 
+// the launch args choose another allocator, the state is not used yet
+static void
+snlua_rebuild(struct snlua *l, int arena) {
+	snlua_close(l);
+	l->mem = 0;
+	l->prepared = 0;
+	l->arena = arena ? arena_new() : NULL;
+	l->L = lua_newstate(lalloc, l);
+	l->activeL = l->L;
+}
+
+// prewarm pool : snlua_pool = N in config keeps N states prepared by a thread ahead of snlua_create,
+// so newservice only binds the context and runs the loader.
+
+#define PREWARM_MAX 4096
+
+struct prewarm {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int size;
+	int n;
+	struct snlua ** state;
+	struct snlua_env env;
+};
+
+static ATOM_INT SETUP_INIT;
+static ATOM_POINTER PREWARM;	// struct prewarm *
+
+static char *
+env_dup(const char *str) {
+	return str ? skynet_strdup(str) : NULL;
+}
+
+static void *
+prewarm_thread(void *ud) {
+	struct prewarm *p = ud;
+	for (;;) {
+		pthread_mutex_lock(&p->lock);
+		while (p->n >= p->size) {
+			pthread_cond_wait(&p->cond, &p->lock);
+		}
+		pthread_mutex_unlock(&p->lock);
+
+		struct snlua *l = snlua_new(ARENA_DEFAULT);
+		if (prepare_state(l, &p->env) != LUA_OK) {
+			// snlua_create builds the state itself, and init_cb reports the error
+			skynet_error(NULL, "snlua prewarm stop : %s", lua_tostring(l->L, -1));
+			snlua_close(l);
+			skynet_free(l);
+			pthread_mutex_lock(&p->lock);
+			p->size = 0;
+			pthread_mutex_unlock(&p->lock);
+			continue;
+		}
+		l->prepared = 1;
+		pthread_mutex_lock(&p->lock);
+		p->state[p->n++] = l;
+		pthread_mutex_unlock(&p->lock);
+	}
+	return NULL;
+}
+
+// read the config in the first snlua_init (bootstrap)
+static void
+snlua_setup(struct skynet_context *ctx) {
+	int zero = 0;
+	if (ATOM_LOAD(&SETUP_INIT) || !ATOM_CAS(&SETUP_INIT, zero, 1))
+		return;
+	const char * arena = skynet_command(ctx, "GETENV", "snlua_arena");
+	ARENA_DEFAULT = arena && strtol(arena, NULL, 10) != 0;
+	const char * pool = skynet_command(ctx, "GETENV", "snlua_pool");
+	int size = pool ? strtol(pool, NULL, 10) : 0;
+	if (size <= 0)
+		return;
+	if (size > PREWARM_MAX)
+		size = PREWARM_MAX;
+	struct prewarm *p = skynet_malloc(sizeof(*p));
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	p->size = size;
+	p->n = 0;
+	p->state = skynet_malloc(size * sizeof(struct snlua *));
+	struct snlua_env env;
+	snlua_getenv(ctx, &env);
+	p->env.path = env_dup(env.path);
+	p->env.cpath = env_dup(env.cpath);
+	p->env.service = env_dup(env.service);
+	p->env.preload = env_dup(env.preload);
+	p->env.loader = env_dup(env.loader);
+
+	pthread_t pid;
+	if (pthread_create(&pid, NULL, prewarm_thread, p)) {
+		skynet_error(ctx, "Create snlua prewarm thread failed");
+		return;
+	}
+	pthread_detach(pid);
+	ATOM_STORE(&PREWARM, (uintptr_t)p);
+}
+
+static struct snlua *
+prewarm_take(struct prewarm *p) {
+	struct snlua *l = NULL;
+	pthread_mutex_lock(&p->lock);
+	if (p->n > 0) {
+		l = p->state[--p->n];
+	}
+	pthread_cond_signal(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+	return l;
+}
+
+struct snlua *
+snlua_create(void) {
+	struct prewarm *p = (struct prewarm *)ATOM_LOAD(&PREWARM);
+	if (p) {
+		struct snlua *l = prewarm_take(p);
+		if (l)
+			return l;
+	}
+	return snlua_new(ARENA_DEFAULT);
+}
+
 void
 snlua_release(struct snlua *l) {
-	lua_close(l->L);
+	snlua_close(l);
+	if (l->sampler) {
+		sampler_delete(l->sampler);
+	}
 	skynet_free(l);
 }
 
+static void
+set_trap(struct snlua *l, int trace) {
+	if (ATOM_LOAD(&l->trap) == 0) {
+		int zero = 0;
+		// only one thread can set trap ( l->trap 0->1 )
+		if (!ATOM_CAS(&l->trap, zero, 1))
+			return;
+		ATOM_STORE(&l->trace, trace);
+		lua_sethook (l->activeL, signal_hook, LUA_MASKCOUNT, 1);
+		// finish set ( l->trap 1 -> -1 )
+		int one = 1;
+		ATOM_CAS(&l->trap, one, -1);
+	} else if (!trace) {
+		// a pending traceback becomes an error
+		ATOM_STORE(&l->trace, 0);
+	}
+}
+
 void
 snlua_signal(struct snlua *l, int signal) {
-	skynet_error(l->ctx, "recv a signal %d", signal);
+	if (signal != 2) {
+		// signal 2 comes with every stall, the monitor has logged it
+		skynet_error(l->ctx, "recv a signal %d", signal);
+	}
 	if (signal == 0) {
-		if (ATOM_LOAD(&l->trap) == 0) {
-			int zero = 0;
-			// only one thread can set trap ( l->trap 0->1 )
-			if (!ATOM_CAS(&l->trap, zero, 1))
-				return;
-			lua_sethook (l->activeL, signal_hook, LUA_MASKCOUNT, 1);
-			// finish set ( l->trap 1 -> -1 )
-			int one = 1;
-			ATOM_CAS(&l->trap, one, -1);
-		}
+		set_trap(l, 0);
+	} else if (signal == 2) {
+		// from the monitor thread when it stalls, see skynet_monitor.c
+		set_trap(l, 1);
 	} else if (signal == 1) {
-		skynet_error(l->ctx, "Current Memory %.3fK", (float)l->mem / 1024);
+		if (l->arena) {
+			skynet_error(l->ctx, "Current Memory %.3fK, arena %dK", (float)l->mem / 1024, l->arena->chunks * (ARENA_CHUNK / 1024));
+		} else {
+			skynet_error(l->ctx, "Current Memory %.3fK", (float)l->mem / 1024);
+		}
 	}
 }
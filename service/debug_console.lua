@@ -171,6 +171,10 @@ function COMMAND.help()
 		dumpheap = "dumpheap : dump heap profilling",
 		killtask = "killtask address threadname : threadname listed by task",
 		dbgcmd = "run address debug command",
+		affinity = "affinity : show thread to cpu mapping",
+		latency = "latency address : show queue wait and callback time (us) of each message type",
+		stall = "stall : show the recent messages running longer than stall_threshold",
+		profile = "profile address [sec] [hz] [file] : sample lua stacks (10s, 100hz by default), output collapsed stacks for flamegraph",
 	}
 end
 
@@ -288,6 +292,21 @@ function COMMAND.task(address)
 	return COMMAND.dbgcmd(address, "TASK")
 end
 
+function COMMAND.latency(address)
+	return COMMAND.dbgcmd(address, "LATENCY")
+end
+
+function COMMAND.profile(address, sec, hz, filename)
+	local stacks, samples = COMMAND.dbgcmd(address, "PROFILE", tonumber(sec) or 10, tonumber(hz))
+	if filename then
+		local f = assert(io.open(filename, "w"))
+		f:write(stacks)
+		f:close()
+		return string.format("%d samples, write to %s", samples, filename)
+	end
+	return stacks
+end
+
 function COMMAND.killtask(address, threadname)
 	return COMMAND.dbgcmd(address, "KILLTASK", threadname)
 end
@@ -357,6 +376,25 @@ function COMMAND.signal(address, sig)
 	end
 end
 
+function COMMAND.stall()
+	local list = {}
+	for _, r in ipairs(core.stall()) do
+		-- r.time is skynet.now() in ms
+		local tag = string.format("%s.%03d :%08x", os.date("%Y-%m-%d %H:%M:%S", skynet.starttime() + r.time // 1000), r.time % 1000, r.destination)
+		list[tag] = string.format("from :%08x %dms%s", r.source, r.duration, r.trace ~= "" and ("\n" .. r.trace) or "")
+	end
+	return list
+end
+
+function COMMAND.affinity()
+	local info = core.command("STAT", "affinity")
+	local tmp = {}
+	for name, cpu in info:gmatch "(%w+):(%S+)" do
+		tmp[name] = cpu
+	end
+	return tmp
+end
+
 function COMMAND.jmem()
 	local info = memory.jestat()
 	local tmp = {}
@@ -443,9 +481,10 @@ end
 
 function COMMAND.cmem()
 	local info = memory.info()
+	local peak = memory.peak()
 	local tmp = {}
 	for k,v in pairs(info) do
-		tmp[skynet.address(k)] = v
+		tmp[skynet.address(k)] = string.format("%d (peak %d)", v, peak[k] or v)
 	end
 	tmp.total = bytes(memory.total())
 	tmp.block = memory.block()
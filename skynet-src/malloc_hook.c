@@ -8,6 +8,7 @@
 #include "malloc_hook.h"
 #include "skynet.h"
 #include "atomic.h"
+#include "spinlock.h"
 
 // turn on MEMORY_CHECK can do more memory check, such as double free
 // #define MEMORY_CHECK
@@ -15,14 +16,6 @@
 #define MEMORY_ALLOCTAG 0x20140605
 #define MEMORY_FREETAG 0x0badf00d
 
-static ATOM_SIZET _used_memory = 0;
-static ATOM_SIZET _memory_block = 0;
-
-struct mem_data {
-	uint32_t handle;
-	ssize_t allocated;
-};
-
 struct mem_cookie {
 	uint32_t handle;
 #ifdef MEMORY_CHECK
@@ -30,12 +23,8 @@ struct mem_cookie {
 #endif
 };
 
-#define SLOT_SIZE 0x10000
 #define PREFIX_SIZE sizeof(struct mem_cookie)
 
-static struct mem_data mem_stats[SLOT_SIZE];
-
-
 #ifndef NOUSE_JEMALLOC
 
 #include "jemalloc.h"
@@ -44,47 +33,226 @@ static struct mem_data mem_stats[SLOT_SIZE];
 #define raw_realloc je_realloc
 #define raw_free je_free
 
-static ssize_t*
-get_allocated_field(uint32_t handle) {
-	int h = (int)(handle & (SLOT_SIZE - 1)); //5λ
-	struct mem_data *data = &mem_stats[h];
-	uint32_t old_handle = data->handle;
-	ssize_t old_alloc = data->allocated;
-	if(old_handle == 0 || old_alloc <= 0) {
-		// data->allocated may less than zero, because it may not count at start.
-		if(!ATOM_CAS(&data->handle, old_handle, handle)) {
-			return 0;
+#else
+
+// for skynet_lalloc use
+#define raw_realloc realloc
+#define raw_free free
+
+#endif
+
+// ̼߳ : ÿ̰߳ѷǵԼһСֱӳ仺( handle Ϊ)
+// ĳ handle Ĳֵ MEM_FLUSH߲λ handle ռʱżϲ
+// ʱѹ̵߳Ļÿ߳ͺ MEM_FLUSH ֽڣֵҲȡ
+
+#define MEM_CACHE 256
+#define MEM_FLUSH (64 * 1024)
+
+struct mem_delta {
+	uint32_t handle;
+	ssize_t allocated;	// not flushed to mem_stats
+};
+
+// never freed, the caches of the exited threads are still merged
+struct mem_thread {
+	struct mem_thread * next;
+	ssize_t used;
+	ssize_t block;
+	struct mem_delta cache[MEM_CACHE];
+};
+
+struct mem_data {
+	uint32_t handle;
+	int used;
+	ssize_t allocated;
+	ssize_t peak;
+};
+
+struct mem_table {
+	int cap;
+	int n;
+	struct mem_data * slot;
+};
+
+struct mem_stats {
+	struct spinlock lock;
+	struct mem_table t;
+};
+
+static struct mem_stats mem_stats;
+static ATOM_POINTER mem_threads;	// struct mem_thread *
+static ATOM_INT mem_init;
+
+static void
+mem_stats_init(void) {
+	int zero = 0;
+	if (ATOM_LOAD(&mem_init) == 0 && ATOM_CAS(&mem_init, zero, 1)) {
+		SPIN_INIT(&mem_stats)
+	}
+}
+
+static inline uint32_t
+mem_hash(uint32_t handle) {
+	return handle * 2654435761u;
+}
+
+static struct mem_data *
+table_find(struct mem_table *t, uint32_t handle) {
+	if (t->cap == 0)
+		return NULL;
+	int i = mem_hash(handle) & (t->cap - 1);
+	for (;;) {
+		struct mem_data *data = &t->slot[i];
+		if (!data->used)
+			return NULL;
+		if (data->handle == handle)
+			return data;
+		i = (i + 1) & (t->cap - 1);
+	}
+}
+
+static struct mem_data *
+table_insert(struct mem_table *t, uint32_t handle);
+
+// drop the handles back to zero (the exited services mostly, with their peak), and grow if it's still crowded
+static void
+table_rehash(struct mem_table *t, int cap) {
+	struct mem_table nt;
+	nt.cap = 16;
+	while (nt.cap < cap)
+		nt.cap *= 2;
+	nt.n = 0;
+	nt.slot = raw_realloc(NULL, nt.cap * sizeof(struct mem_data));
+	memset(nt.slot, 0, nt.cap * sizeof(struct mem_data));
+	int i;
+	for (i=0;i<t->cap;i++) {
+		struct mem_data *data = &t->slot[i];
+		if (data->allocated != 0) {
+			*table_insert(&nt, data->handle) = *data;
+		}
+	}
+	raw_free(t->slot);
+	*t = nt;
+}
+
+static struct mem_data *
+table_insert(struct mem_table *t, uint32_t handle) {
+	struct mem_data *data = table_find(t, handle);
+	if (data)
+		return data;
+	if ((t->n + 1) * 4 > t->cap * 3) {
+		int live = 0;
+		int i;
+		for (i=0;i<t->cap;i++) {
+			if (t->slot[i].allocated != 0)
+				++live;
 		}
-		if (old_alloc < 0) {
-			ATOM_CAS(&data->allocated, old_alloc, 0);
+		table_rehash(t, (live + 1) * 2);
+	}
+	int i = mem_hash(handle) & (t->cap - 1);
+	while (t->slot[i].used)
+		i = (i + 1) & (t->cap - 1);
+	data = &t->slot[i];
+	data->handle = handle;
+	data->used = 1;
+	data->allocated = 0;
+	data->peak = 0;
+	++t->n;
+	return data;
+}
+
+// a copy of mem_stats with the caches of all threads added, free slot with raw_free
+static struct mem_table
+mem_merge(void) {
+	int threads = 0;
+	struct mem_thread *mt;
+	for (mt = (struct mem_thread *)ATOM_LOAD(&mem_threads); mt; mt = mt->next)
+		++threads;
+	struct mem_table t = { 0, 0, NULL };
+	mem_stats_init();
+	SPIN_LOCK(&mem_stats)
+	table_rehash(&t, (mem_stats.t.n + threads * MEM_CACHE + 1) * 2);
+	int i;
+	for (i=0;i<mem_stats.t.cap;i++) {
+		struct mem_data *data = &mem_stats.t.slot[i];
+		if (data->used) {
+			*table_insert(&t, data->handle) = *data;
 		}
 	}
-	if(data->handle != handle) {
-		return 0;
+	SPIN_UNLOCK(&mem_stats)
+	for (mt = (struct mem_thread *)ATOM_LOAD(&mem_threads); mt; mt = mt->next) {
+		for (i=0;i<MEM_CACHE;i++) {
+			// the owner may change it now, it's fine for a report
+			struct mem_delta d = mt->cache[i];
+			if (d.allocated != 0) {
+				struct mem_data *data = table_insert(&t, d.handle);
+				data->allocated += d.allocated;
+				if (data->allocated > data->peak)
+					data->peak = data->allocated;
+			}
+		}
 	}
-	return &data->allocated;
+	return t;
+}
+
+#ifndef NOUSE_JEMALLOC
+
+// not pthread_getspecific, pthread_setspecific may call malloc (this hook)
+static __thread struct mem_thread * mem_current = NULL;
+
+static struct mem_thread *
+mem_thread_new(void) {
+	mem_stats_init();
+	struct mem_thread *mt = raw_realloc(NULL, sizeof(*mt));
+	memset(mt, 0, sizeof(*mt));
+	uintptr_t head;
+	do {
+		head = ATOM_LOAD(&mem_threads);
+		mt->next = (struct mem_thread *)head;
+	} while (!ATOM_CAS_POINTER(&mem_threads, head, (uintptr_t)mt));
+	mem_current = mt;
+	return mt;
+}
+
+static void
+mem_flush(struct mem_delta *d) {
+	SPIN_LOCK(&mem_stats)
+	struct mem_data *data = table_insert(&mem_stats.t, d->handle);
+	data->allocated += d->allocated;
+	if (data->allocated > data->peak)
+		data->peak = data->allocated;
+	SPIN_UNLOCK(&mem_stats)
+	d->allocated = 0;
+}
+
+static inline void
+mem_charge(uint32_t handle, ssize_t n) {
+	struct mem_thread *mt = mem_current;
+	if (mt == NULL)
+		mt = mem_thread_new();
+	mt->used += n;
+	mt->block += n > 0 ? 1 : -1;
+	struct mem_delta *d = &mt->cache[mem_hash(handle) & (MEM_CACHE - 1)];
+	if (d->handle != handle) {
+		if (d->allocated != 0)
+			mem_flush(d);
+		d->handle = handle;
+	}
+	d->allocated += n;
+	if (d->allocated >= MEM_FLUSH || d->allocated <= -MEM_FLUSH)
+		mem_flush(d);
 }
 
 //ڴ״̬
 inline static void
 update_xmalloc_stat_alloc(uint32_t handle, size_t __n) {
-	ATOM_FADD(&_used_memory, __n); //ڴ
-	ATOM_FINC(&_memory_block); //
-	ssize_t* allocated = get_allocated_field(handle); //Ӧmem_statsѷС
-	if(allocated) {
-		ATOM_FADD(allocated, __n); //
-	}
+	mem_charge(handle, (ssize_t)__n);
 }
 
 //ڴͷŸ״̬
 inline static void
 update_xmalloc_stat_free(uint32_t handle, size_t __n) {
-	ATOM_FSUB(&_used_memory, __n);
-	ATOM_FDEC(&_memory_block);
-	ssize_t* allocated = get_allocated_field(handle);
-	if(allocated) {
-		ATOM_FSUB(allocated, __n);
-	}
+	mem_charge(handle, -(ssize_t)__n);
 }
 
 inline static void*
@@ -241,10 +409,6 @@ skynet_posix_memalign(void **memptr, size_t alignment, size_t size) {
 
 #else
 
-// for skynet_lalloc use
-#define raw_realloc realloc
-#define raw_free free
-
 void
 memory_info_dump(const char* opts) {
 	skynet_error(NULL, "No jemalloc");
@@ -278,26 +442,36 @@ mallctl_cmd(const char* name) {
 
 size_t
 malloc_used_memory(void) {
-	return ATOM_LOAD(&_used_memory);
+	ssize_t used = 0;
+	struct mem_thread *mt;
+	for (mt = (struct mem_thread *)ATOM_LOAD(&mem_threads); mt; mt = mt->next)
+		used += mt->used;
+	return (size_t)used;
 }
 
 size_t
 malloc_memory_block(void) {
-	return ATOM_LOAD(&_memory_block);
+	ssize_t block = 0;
+	struct mem_thread *mt;
+	for (mt = (struct mem_thread *)ATOM_LOAD(&mem_threads); mt; mt = mt->next)
+		block += mt->block;
+	return (size_t)block;
 }
 
 void
 dump_c_mem() {
 	int i;
 	size_t total = 0;
+	struct mem_table t = mem_merge();
 	skynet_error(NULL, "dump all service mem:");
-	for(i=0; i<SLOT_SIZE; i++) {
-		struct mem_data* data = &mem_stats[i];
+	for(i=0; i<t.cap; i++) {
+		struct mem_data* data = &t.slot[i];
 		if(data->handle != 0 && data->allocated != 0) {
 			total += data->allocated;
-			skynet_error(NULL, ":%08x -> %zdkb %db", data->handle, data->allocated >> 10, (int)(data->allocated % 1024));
+			skynet_error(NULL, ":%08x -> %zdkb %db, peak %zdkb", data->handle, data->allocated >> 10, (int)(data->allocated % 1024), data->peak >> 10);
 		}
 	}
+	raw_free(t.slot);
 	skynet_error(NULL, "+total: %zdkb",total >> 10);
 }
 
@@ -325,31 +499,50 @@ skynet_lalloc(void *ptr, size_t osize, size_t nsize) {
 //cmem ϸϽָ÷ڴ棬˳ζڴһͷš
 //磺ͳȥϢҪȽշͷšlua require  dll ܲ vm  dlclose ʱͷŸɾȵȡһЩһһö١ȤԴһЩ log ׷١
 //ps.  code cache  skynet  lua vm ᱣͷǧַһͷŶַ
-int
-dump_mem_lua(lua_State *L) {
+static int
+dump_lua(lua_State *L, int peak) {
 	int i;
+	struct mem_table t = mem_merge();
 	lua_newtable(L);
-	for(i=0; i<SLOT_SIZE; i++) {
-		struct mem_data* data = &mem_stats[i];
+	for(i=0; i<t.cap; i++) {
+		struct mem_data* data = &t.slot[i];
 		if(data->handle != 0 && data->allocated != 0) {
-			lua_pushinteger(L, data->allocated);
+			lua_pushinteger(L, peak ? data->peak : data->allocated);
 			lua_rawseti(L, -2, (lua_Integer)data->handle);
 		}
 	}
+	raw_free(t.slot);
 	return 1;
 }
 
+int
+dump_mem_lua(lua_State *L) {
+	return dump_lua(L, 0);
+}
+
+// the high-water mark of each service, in MEM_FLUSH bytes per thread
+int
+dump_peak_lua(lua_State *L) {
+	return dump_lua(L, 1);
+}
+
 size_t
 malloc_current_memory(void) {
 	uint32_t handle = skynet_current_handle();
-	int i;
-	for(i=0; i<SLOT_SIZE; i++) {
-		struct mem_data* data = &mem_stats[i];
-		if(data->handle == (uint32_t)handle && data->allocated != 0) {
-			return (size_t) data->allocated;
-		}
+	ssize_t allocated = 0;
+	mem_stats_init();
+	SPIN_LOCK(&mem_stats)
+	struct mem_data *data = table_find(&mem_stats.t, handle);
+	if (data)
+		allocated = data->allocated;
+	SPIN_UNLOCK(&mem_stats)
+	struct mem_thread *mt;
+	for (mt = (struct mem_thread *)ATOM_LOAD(&mem_threads); mt; mt = mt->next) {
+		struct mem_delta d = mt->cache[mem_hash(handle) & (MEM_CACHE - 1)];
+		if (d.handle == handle)
+			allocated += d.allocated;
 	}
-	return 0;
+	return allocated > 0 ? (size_t)allocated : 0;
 }
 
 void
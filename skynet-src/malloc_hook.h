@@ -14,6 +14,7 @@ extern bool   mallctl_bool(const char* name, bool* newval);
 extern int    mallctl_cmd(const char* name);
 extern void   dump_c_mem(void);
 extern int    dump_mem_lua(lua_State *L);
+extern int    dump_peak_lua(lua_State *L);
 extern size_t malloc_current_memory(void);
 
 #endif /* SKYNET_MALLOC_HOOK_H */
@@ -31,14 +31,35 @@ const char * skynet_command(struct skynet_context * context, const char * cmd ,
 uint32_t skynet_queryname(struct skynet_context * context, const char * name);
 int skynet_send(struct skynet_context * context, uint32_t source, uint32_t destination , int type, int session, void * msg, size_t sz);
 int skynet_sendname(struct skynet_context * context, uint32_t source, const char * destination , int type, int session, void * msg, size_t sz);
+// send one message to n services, the payload is shared (not copied) by the receivers. return the number of services it is sent to
+int skynet_send_batch(struct skynet_context * context, uint32_t source, const uint32_t destination[], int n, int type, int session, void * msg, size_t sz);
 
 int skynet_isremote(struct skynet_context *, uint32_t handle, int * harbor);
 
 typedef int (*skynet_cb)(struct skynet_context * context, void *ud, int type, int session, uint32_t source , const void * msg, size_t sz);
 void skynet_callback(struct skynet_context * context, void *ud, skynet_cb cb);
+// cb never keeps msg (always returns 0), so the payload of skynet_send_batch can be read in place without a copy
+void skynet_callback_borrow(struct skynet_context * context, int borrow);
+
 
 uint32_t skynet_current_handle(void);
-uint64_t skynet_now(void);
+uint64_t skynet_now(void);	// in 1/100 second
+uint64_t skynet_now_ms(void);	// in millisecond, as precise as timer_resolution
 void skynet_debug_memory(const char *info);	// for debug use, output current service memory to stderr
 
+// the stalls found by the monitor thread (config stall_threshold), see skynet_monitor.c
+struct skynet_stall {
+	uint64_t time;	// skynet_now_ms() when it's found
+	uint32_t source;
+	uint32_t destination;
+	uint32_t duration;	// in ms, updated until the message returns
+	char trace[1024];	// filled by the stalled service, may be empty
+};
+
+// the stalled service reports where it is (snlua does it on signal 2), in the worker thread running it.
+// return 0 if the stalled message has returned, the trace is from another message and is dropped
+int skynet_stall_traceback(struct skynet_context *ctx, const char *trace);
+// copy the last n (at most 64) stalls into buffer, oldest first, return the number copied
+int skynet_stall_history(struct skynet_stall *buffer, int n);
+
 #endif
@@ -0,0 +1,374 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "skynet.h"
+#include "skynet_affinity.h"
+#include "skynet_imp.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+/*
+线程绑核，配置项都是 cpu 列表，格式同 /sys 下的 cpulist，例如 "0-7,16-23"
+affinity_monitor / affinity_timer / affinity_socket : 该线程绑在整个列表上
+affinity_worker : 第 i 个工作线程绑列表里的第 i 个 cpu (不够时回绕)
+	"numa" 表示按 NUMA 节点分组，工作线程平均分到各个节点，绑在节点的所有 cpu 上
+工作线程所在的节点会告诉 work steal 调度，空闲时优先从同节点的线程偷
+注意这里不按节点分配内存：服务的 context 和消息队列由创建它的线程分配，之后它进的是给它发消息的线程的本地队列，
+并不会固定在内存所在的节点上
+*/
+
+#define MAX_CPU 1024
+#define MAX_NODE 64
+
+struct cpumask {
+	unsigned char bits[MAX_CPU / 8];
+};
+
+struct affinity {
+	struct cpumask monitor;
+	struct cpumask timer;
+	struct cpumask socket;
+	int worker_count;
+	struct cpumask *worker;
+	int *node;
+	char *info;
+};
+
+static struct affinity *A = NULL;
+
+static inline void
+mask_set(struct cpumask *m, int cpu) {
+	m->bits[cpu / 8] |= 1 << (cpu % 8);
+}
+
+static inline int
+mask_test(const struct cpumask *m, int cpu) {
+	return m->bits[cpu / 8] & (1 << (cpu % 8));
+}
+
+static int
+mask_empty(const struct cpumask *m) {
+	int i;
+	for (i=0;i<sizeof(m->bits);i++) {
+		if (m->bits[i])
+			return 0;
+	}
+	return 1;
+}
+
+// "0-3,8,10-11" , return -1 if invalid
+static int
+parse_cpulist(const char *str, struct cpumask *m) {
+	memset(m, 0, sizeof(*m));
+	const char *p = str;
+	while (*p) {
+		while (isspace((unsigned char)*p) || *p == ',')
+			++p;
+		if (*p == '\0')
+			break;
+		if (!isdigit((unsigned char)*p))
+			return -1;
+		char *end;
+		long from = strtol(p, &end, 10);
+		long to = from;
+		p = end;
+		if (*p == '-') {
+			++p;
+			if (!isdigit((unsigned char)*p))
+				return -1;
+			to = strtol(p, &end, 10);
+			p = end;
+		}
+		if (from < 0 || to >= MAX_CPU || from > to)
+			return -1;
+		long i;
+		for (i=from;i<=to;i++) {
+			mask_set(m, i);
+		}
+	}
+	return mask_empty(m) ? -1 : 0;
+}
+
+static int
+mask_nth(const struct cpumask *m, int n) {
+	int count = 0;
+	int i;
+	for (i=0;i<MAX_CPU;i++) {
+		if (mask_test(m, i))
+			++count;
+	}
+	if (count == 0)
+		return -1;
+	n %= count;
+	for (i=0;i<MAX_CPU;i++) {
+		if (mask_test(m, i)) {
+			if (n-- == 0)
+				return i;
+		}
+	}
+	return -1;
+}
+
+static int
+read_list(const char *path, struct cpumask *m) {
+	char buf[4096];
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+	size_t n = fread(buf, 1, sizeof(buf)-1, f);
+	fclose(f);
+	buf[n] = '\0';
+	return parse_cpulist(buf, m);
+}
+
+// the online node ids may have holes, such as "0,2-3". nodes[i] is the cpu list of node id[i]
+// return the number of numa nodes
+static int
+read_nodes(struct cpumask *nodes, int id[]) {
+	struct cpumask online;
+	if (read_list("/sys/devices/system/node/online", &online))
+		return 0;
+	char path[64];
+	int n = 0;
+	int i;
+	for (i=0;i<MAX_CPU && n<MAX_NODE;i++) {
+		if (!mask_test(&online, i))
+			continue;
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", i);
+		// a memory only node has an empty cpu list
+		if (read_list(path, &nodes[n]) == 0) {
+			id[n++] = i;
+		}
+	}
+	return n;
+}
+
+static int
+cpu_node(struct cpumask *nodes, const int id[], int n, int cpu) {
+	int i;
+	for (i=0;i<n;i++) {
+		if (mask_test(&nodes[i], cpu))
+			return id[i];
+	}
+	return -1;
+}
+
+static void
+config_mask(const char *key, const char *str, struct cpumask *m) {
+	if (str == NULL)
+		return;
+	if (parse_cpulist(str, m)) {
+		fprintf(stderr, "Invalid cpu list %s = %s\n", key, str);
+		exit(1);
+	}
+}
+
+struct strbuf {
+	char *buf;
+	size_t sz;
+	size_t cap;
+};
+
+static void
+strbuf_append(struct strbuf *b, const char *s) {
+	size_t n = strlen(s);
+	if (b->sz + n + 1 > b->cap) {
+		size_t cap = (b->cap == 0) ? 256 : b->cap;
+		while (b->sz + n + 1 > cap)
+			cap *= 2;
+		char *buf = skynet_malloc(cap);
+		if (b->buf) {
+			memcpy(buf, b->buf, b->sz);
+			skynet_free(b->buf);
+		}
+		b->buf = buf;
+		b->cap = cap;
+	}
+	memcpy(b->buf + b->sz, s, n + 1);
+	b->sz += n;
+}
+
+static void
+strbuf_mask(struct strbuf *b, const struct cpumask *m) {
+	if (mask_empty(m)) {
+		strbuf_append(b, "*");
+		return;
+	}
+	char tmp[32];
+	int first = 1;
+	int i = 0;
+	while (i < MAX_CPU) {
+		if (!mask_test(m, i)) {
+			++i;
+			continue;
+		}
+		int j = i;
+		while (j+1 < MAX_CPU && mask_test(m, j+1))
+			++j;
+		if (i == j) {
+			snprintf(tmp, sizeof(tmp), "%s%d", first ? "" : ",", i);
+		} else {
+			snprintf(tmp, sizeof(tmp), "%s%d-%d", first ? "" : ",", i, j);
+		}
+		strbuf_append(b, tmp);
+		first = 0;
+		i = j + 1;
+	}
+}
+
+static char *
+build_info(struct affinity *a) {
+	struct strbuf b = { NULL, 0, 0 };
+	char tmp[64];
+	strbuf_append(&b, "monitor:");
+	strbuf_mask(&b, &a->monitor);
+	strbuf_append(&b, " timer:");
+	strbuf_mask(&b, &a->timer);
+	strbuf_append(&b, " socket:");
+	strbuf_mask(&b, &a->socket);
+	int i;
+	for (i=0;i<a->worker_count;i++) {
+		snprintf(tmp, sizeof(tmp), " worker%d:", i);
+		strbuf_append(&b, tmp);
+		strbuf_mask(&b, &a->worker[i]);
+		if (a->node[i] >= 0) {
+			snprintf(tmp, sizeof(tmp), "(node%d)", a->node[i]);
+			strbuf_append(&b, tmp);
+		}
+	}
+	return b.buf;
+}
+
+static void
+config_worker(struct affinity *a, const char *str) {
+	struct cpumask *nodes = skynet_malloc(MAX_NODE * sizeof(struct cpumask));
+	int id[MAX_NODE];
+	int nnode = read_nodes(nodes, id);
+	int n = a->worker_count;
+	int i;
+	if (str && strcmp(str, "numa") == 0) {
+		if (nnode == 0) {
+			fprintf(stderr, "affinity_worker = numa, but no numa node found\n");
+		}
+		for (i=0;i<n && nnode > 0;i++) {
+			// keep the neighbouring workers in the same node
+			int node = i * nnode / n;
+			a->worker[i] = nodes[node];
+			a->node[i] = id[node];
+		}
+	} else if (str) {
+		struct cpumask m;
+		config_mask("affinity_worker", str, &m);
+		for (i=0;i<n;i++) {
+			int cpu = mask_nth(&m, i);
+			mask_set(&a->worker[i], cpu);
+			a->node[i] = cpu_node(nodes, id, nnode, cpu);
+		}
+	}
+	skynet_free(nodes);
+}
+
+void
+skynet_affinity_init(struct skynet_config *config) {
+	struct affinity *a = skynet_malloc(sizeof(*a));
+	memset(a, 0, sizeof(*a));
+	config_mask("affinity_monitor", config->affinity_monitor, &a->monitor);
+	config_mask("affinity_timer", config->affinity_timer, &a->timer);
+	config_mask("affinity_socket", config->affinity_socket, &a->socket);
+	a->worker_count = config->thread;
+	a->worker = skynet_malloc(config->thread * sizeof(struct cpumask));
+	memset(a->worker, 0, config->thread * sizeof(struct cpumask));
+	a->node = skynet_malloc(config->thread * sizeof(int));
+	int i;
+	for (i=0;i<config->thread;i++) {
+		a->node[i] = -1;
+	}
+	config_worker(a, config->affinity_worker);
+	a->info = build_info(a);
+#ifndef __linux__
+	if (config->affinity_monitor || config->affinity_timer || config->affinity_socket || config->affinity_worker) {
+		fprintf(stderr, "Thread affinity is only supported on linux, ignore it\n");
+	}
+#endif
+	A = a;
+}
+
+void
+skynet_affinity_exit(void) {
+	struct affinity *a = A;
+	if (a == NULL)
+		return;
+	A = NULL;
+	skynet_free(a->worker);
+	skynet_free(a->node);
+	skynet_free(a->info);
+	skynet_free(a);
+}
+
+void
+skynet_affinity_bind(int type, int id) {
+	struct affinity *a = A;
+	if (a == NULL)
+		return;
+	const struct cpumask *m = NULL;
+	switch (type) {
+	case THREAD_WORKER:
+		if (id >= 0 && id < a->worker_count)
+			m = &a->worker[id];
+		break;
+	case THREAD_SOCKET:
+		m = &a->socket;
+		break;
+	case THREAD_TIMER:
+		m = &a->timer;
+		break;
+	case THREAD_MONITOR:
+		m = &a->monitor;
+		break;
+	}
+	if (m == NULL || mask_empty(m))
+		return;
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	int i;
+	for (i=0;i<MAX_CPU && i<CPU_SETSIZE;i++) {
+		if (mask_test(m, i))
+			CPU_SET(i, &set);
+	}
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (err) {
+		skynet_error(NULL, "Set thread affinity failed (type = %d id = %d) : %s", type, id, strerror(err));
+	}
+#endif
+}
+
+const int *
+skynet_affinity_node(void) {
+	struct affinity *a = A;
+	if (a == NULL)
+		return NULL;
+	int i;
+	for (i=0;i<a->worker_count;i++) {
+		if (a->node[i] >= 0)
+			return a->node;
+	}
+	return NULL;
+}
+
+const char *
+skynet_affinity_info(void) {
+	struct affinity *a = A;
+	if (a == NULL)
+		return "";
+	return a->info;
+}
@@ -0,0 +1,16 @@
+#ifndef skynet_affinity_h
+#define skynet_affinity_h
+
+struct skynet_config;
+
+// parse affinity_* in config, must call before the threads start
+void skynet_affinity_init(struct skynet_config *config);
+void skynet_affinity_exit(void);
+// pin the calling thread, type is THREAD_WORKER/THREAD_SOCKET/THREAD_TIMER/THREAD_MONITOR, id is the worker id
+void skynet_affinity_bind(int type, int id);
+// numa node of workers, NULL if unknown
+const int * skynet_affinity_node(void);
+// thread -> cpu mapping, for debug
+const char * skynet_affinity_info(void);
+
+#endif
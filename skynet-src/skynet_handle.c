@@ -3,38 +3,87 @@
 #include "skynet_handle.h"
 #include "skynet_server.h"
 #include "rwlock.h"
+#include "atomic.h"
 
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 
 #define DEFAULT_SLOT_SIZE 4
+#define DEFAULT_NAME_SIZE 16
 #define MAX_SLOT_SIZE 0x40000000
 
+/*
+别名表是两张共用节点的散列表：按名字散列 (findname/namehandle)，按 handle 散列 (retire 删掉这个服务的所有别名)，
+桶数一样，都是2^n，别名数超过桶数时一起扩容。别名用单独的读写锁，不和 register/retire 抢 slot 的写锁。
+*/
 struct handle_name {
 	char * name;
 	uint32_t handle;
+	uint32_t hash;                 // 名字的散列值
+	struct handle_name *next;      // 名字散列的同桶链
+	struct handle_name *hnext;     // handle 散列的同桶链
+};
+
+/*
+skynet_handle_grab 不加锁：slot 数组整个打包在 slot_table 里，扩容时生成新表再原子地替换指针，
+旧表不释放 (挂在 prev 上)，读者手里的旧表一直有效。旧表里可能还留着已经注销的上下文指针，
+上下文的内存不会还给系统 (见 skynet_server.c 的 CONTEXT_POOL)，所以 grab 先在 ref 不为 0 时加引用，
+再确认 handle 没变并且当前表里还是它，否则放掉引用。
+*/
+struct slot_table {
+	int size;                      // 一定是2^n
+	struct slot_table *prev;       // 被替换掉的旧表，不释放
+	ATOM_POINTER slot[];           // struct skynet_context *
 };
 
 // skynet_context管理器结构
 struct handle_storage {
-	//因为我们访问一个服务的机会，远大于创建一个服务并写入列表的机会，因此这里用了读写锁，
-	//在通过handle获取context指针时，加了一个读取锁，这样当在读取的过程中，
-	//同时有新的服务创建，并且存在要扩充skynet_context list容量的风险( rehash 和长度改变)，因此不论如何，他都应当被阻塞住，直到所有的读取锁都释放掉。
+	// 写 (register/retire/扩容) 用读写锁互斥，按 handle 读上下文不加锁
     struct rwlock lock;            // 读写锁
     
     uint32_t harbor;               // harbor id
     uint32_t handle_index;         // 创建下一个服务时，该服务的slot idx，一般会先判断该slot是否被占用，初始1
-    int slot_size;                 // slot的大小，一定是2^n，初始值是4
-    struct skynet_context ** slot; // skynet_context list
+    ATOM_POINTER table;            // struct slot_table *, 初始大小4
         
-    int name_cap;                  // 别名列表大小，大小为2^n，初始2
+    struct rwlock name_lock;       // 别名表的读写锁
+    int name_cap;                  // 别名表桶数，大小为2^n，初始16
     int name_count;                // 别名数量，初始0
-    struct handle_name *name;      // 别名列表
+    struct handle_name **name;     // 按名字散列
+    struct handle_name **name_of_handle; // 按 handle 散列
 };
 
 static struct handle_storage *H = NULL; // skynet_context管理器
 
+static struct slot_table *
+new_table(int size) {
+	struct slot_table *t = skynet_malloc(sizeof(*t) + size * sizeof(ATOM_POINTER));
+	t->size = size;
+	t->prev = NULL;
+	int i;
+	for (i=0;i<size;i++) {
+		ATOM_INIT(&t->slot[i], (uintptr_t)NULL);
+	}
+	return t;
+}
+
+static uint32_t
+name_hash(const char *name) {
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	const unsigned char *p = (const unsigned char *)name;
+	while (*p) {
+		h ^= *p++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static inline struct skynet_context *
+slot_get(struct slot_table *t, uint32_t handle) {
+	return (struct skynet_context *)ATOM_LOAD(&t->slot[handle & (t->size-1)]);
+}
+
 uint32_t
 skynet_handle_register(struct skynet_context *ctx) {
 	struct handle_storage *s = H;
@@ -42,16 +91,17 @@ skynet_handle_register(struct skynet_context *ctx) {
 	rwlock_wlock(&s->lock); // 锁住写
 	
 	for (;;) {
+		struct slot_table *t = (struct slot_table *)ATOM_LOAD(&s->table);
 		int i;
 		uint32_t handle = s->handle_index;
-		for (i=0;i<s->slot_size;i++,handle++) {
+		for (i=0;i<t->size;i++,handle++) {
 			if (handle > HANDLE_MASK) { // #define HANDLE_MASK 0xffffff 轮回
 				// 0 is reserved
 				handle = 1;
 			}
-			int hash = handle & (s->slot_size-1); // 控制slot list成倍递增，初始4，即可使用0-3
-			if (s->slot[hash] == NULL) {
-				s->slot[hash] = ctx;
+			int hash = handle & (t->size-1); // 控制slot list成倍递增，初始4，即可使用0-3
+			if (ATOM_LOAD(&t->slot[hash]) == (uintptr_t)NULL) {
+				ATOM_STORE(&t->slot[hash], (uintptr_t)ctx);
 				s->handle_index = handle + 1;
 
 				rwlock_wunlock(&s->lock);
@@ -61,20 +111,45 @@ skynet_handle_register(struct skynet_context *ctx) {
 			}
 		}
 		// 位置不足，slot list成倍递增，转存替换
-		assert((s->slot_size*2 - 1) <= HANDLE_MASK);
-		struct skynet_context ** new_slot = skynet_malloc(s->slot_size * 2 * sizeof(struct skynet_context *));
-		memset(new_slot, 0, s->slot_size * 2 * sizeof(struct skynet_context *));
-		for (i=0;i<s->slot_size;i++) {
-			int hash = skynet_context_handle(s->slot[i]) & (s->slot_size * 2 - 1); //rehash
-			assert(new_slot[hash] == NULL);
-			new_slot[hash] = s->slot[i];
+		assert((t->size*2 - 1) <= HANDLE_MASK);
+		struct slot_table *nt = new_table(t->size * 2);
+		for (i=0;i<t->size;i++) {
+			struct skynet_context *c = (struct skynet_context *)ATOM_LOAD(&t->slot[i]);
+			int hash = skynet_context_handle(c) & (nt->size - 1); //rehash
+			assert(ATOM_LOAD(&nt->slot[hash]) == (uintptr_t)NULL);
+			ATOM_STORE(&nt->slot[hash], (uintptr_t)c);
 		}
-		skynet_free(s->slot);
-		s->slot = new_slot;
-		s->slot_size *= 2;
+		nt->prev = t;
+		ATOM_STORE(&s->table, (uintptr_t)nt);
 	}
 }
 
+// 删掉 handle 的所有别名
+static void
+remove_names(struct handle_storage *s, uint32_t handle) {
+	rwlock_wlock(&s->name_lock);
+
+	struct handle_name **pn = &s->name_of_handle[handle & (s->name_cap-1)];
+	while (*pn) {
+		struct handle_name *n = *pn;
+		if (n->handle != handle) {
+			pn = &n->hnext;
+			continue;
+		}
+		*pn = n->hnext;
+		struct handle_name **p = &s->name[n->hash & (s->name_cap-1)];
+		while (*p != n) {
+			p = &(*p)->next;
+		}
+		*p = n->next;
+		skynet_free(n->name);
+		skynet_free(n);
+		--s->name_count;
+	}
+
+	rwlock_wunlock(&s->name_lock);
+}
+
 //注销
 int
 skynet_handle_retire(uint32_t handle) {
@@ -83,24 +158,13 @@ skynet_handle_retire(uint32_t handle) {
 
 	rwlock_wlock(&s->lock);
 
-	uint32_t hash = handle & (s->slot_size-1);
-	struct skynet_context * ctx = s->slot[hash];
+	struct slot_table *t = (struct slot_table *)ATOM_LOAD(&s->table);
+	uint32_t hash = handle & (t->size-1);
+	struct skynet_context * ctx = slot_get(t, handle);
 
 	if (ctx != NULL && skynet_context_handle(ctx) == handle) {
-		s->slot[hash] = NULL; //置空
+		ATOM_STORE(&t->slot[hash], (uintptr_t)NULL); //置空
 		ret = 1;
-		int i;
-		int j=0, n=s->name_count; //删别名
-		for (i=0; i<n; ++i) {
-			if (s->name[i].handle == handle) {
-				skynet_free(s->name[i].name);
-				continue;
-			} else if (i!=j) {
-				s->name[j] = s->name[i];
-			}
-			++j;
-		}
-		s->name_count = j;
 	} else {
 		ctx = NULL;
 	}
@@ -109,6 +173,7 @@ skynet_handle_retire(uint32_t handle) {
 	rwlock_wunlock(&s->lock);
 
 	if (ctx) {
+		remove_names(s, handle);
 		// release ctx may call skynet_handle_* , so wunlock first.
 		skynet_context_release(ctx);
 	}
@@ -122,13 +187,14 @@ skynet_handle_retireall() {
 	for (;;) {
 		int n=0;
 		int i;
-		for (i=0;i<s->slot_size;i++) {
-			rwlock_rlock(&s->lock);
-			struct skynet_context * ctx = s->slot[i];
+		struct slot_table *t = (struct slot_table *)ATOM_LOAD(&s->table);
+		for (i=0;i<t->size;i++) {
+			struct skynet_context * ctx = (struct skynet_context *)ATOM_LOAD(&t->slot[i]);
 			uint32_t handle = 0;
-			if (ctx)
+			if (ctx && skynet_context_trygrab(ctx)) {
 				handle = skynet_context_handle(ctx);
-			rwlock_runlock(&s->lock);
+				skynet_context_release(ctx);
+			}
 			if (handle != 0) {
 				if (skynet_handle_retire(handle)) {
 					++n;
@@ -140,114 +206,132 @@ skynet_handle_retireall() {
 	}
 }
 
+static struct skynet_context *
+grab(struct handle_storage *s, uint32_t handle) {
+	struct slot_table *t = (struct slot_table *)ATOM_LOAD(&s->table);
+	struct skynet_context * ctx = slot_get(t, handle);
+	if (ctx == NULL || !skynet_context_trygrab(ctx)) {
+		return NULL;
+	}
+	// ctx may be retired (and reused) before we grab it
+	if (skynet_context_handle(ctx) == handle) {
+		t = (struct slot_table *)ATOM_LOAD(&s->table);
+		if (slot_get(t, handle) == ctx) {
+			return ctx;
+		}
+	}
+	skynet_context_release(ctx);
+	return NULL;
+}
+
 // 通过 handle 找对应上下文
 struct skynet_context * 
 skynet_handle_grab(uint32_t handle) {
-	struct handle_storage *s = H;
-	struct skynet_context * result = NULL;
-
-	rwlock_rlock(&s->lock); //锁住，避免 skynet_context list 扩容风险
+	return grab(H, handle);
+}
 
-	uint32_t hash = handle & (s->slot_size-1);
-	struct skynet_context * ctx = s->slot[hash];
-	if (ctx && skynet_context_handle(ctx) == handle) {
-		result = ctx;
-		skynet_context_grab(result);
+// 一次取一组上下文，找不到的位置为 NULL，返回找到的个数
+int
+skynet_handle_grab_batch(const uint32_t handles[], int n, struct skynet_context *result[]) {
+	struct handle_storage *s = H;
+	int count = 0;
+	int i;
+	for (i=0;i<n;i++) {
+		result[i] = grab(s, handles[i]);
+		if (result[i]) {
+			++count;
+		}
 	}
-
-	rwlock_runlock(&s->lock);
-
-	return result;
+	return count;
 }
 
 // 通过别名找对应上下文的 ctx->handle 
 uint32_t 
 skynet_handle_findname(const char * name) {
 	struct handle_storage *s = H; //上下文管理器
-
-	rwlock_rlock(&s->lock);
-
+	uint32_t hash = name_hash(name);
 	uint32_t handle = 0;
 
-	int begin = 0;
-	int end = s->name_count - 1;
-	while (begin<=end) { //二分法
-		int mid = (begin+end)/2;
-		struct handle_name *n = &s->name[mid];
-		int c = strcmp(n->name, name);
-		if (c==0) {
+	rwlock_rlock(&s->name_lock);
+
+	struct handle_name *n = s->name[hash & (s->name_cap-1)];
+	while (n) {
+		if (n->hash == hash && strcmp(n->name, name) == 0) {
 			handle = n->handle;
 			break;
 		}
-		if (c<0) {
-			begin = mid + 1;
-		} else {
-			end = mid - 1;
-		}
+		n = n->next;
 	}
 
-	rwlock_runlock(&s->lock);
+	rwlock_runlock(&s->name_lock);
 
 	return handle;
 }
 
 static void
-_insert_name_before(struct handle_storage *s, char *name, uint32_t handle, int before) {
-	if (s->name_count >= s->name_cap) {
-		s->name_cap *= 2;
-		assert(s->name_cap <= MAX_SLOT_SIZE);
-		struct handle_name * n = skynet_malloc(s->name_cap * sizeof(struct handle_name));
-		int i;
-		for (i=0;i<before;i++) {
-			n[i] = s->name[i];
-		}
-		for (i=before;i<s->name_count;i++) {
-			n[i+1] = s->name[i];
-		}
-		skynet_free(s->name);
-		s->name = n;
-	} else {
-		int i;
-		for (i=s->name_count;i>before;i--) {
-			s->name[i] = s->name[i-1];
+expand_names(struct handle_storage *s) {
+	int cap = s->name_cap * 2;
+	assert(cap <= MAX_SLOT_SIZE);
+	struct handle_name **name = skynet_malloc(cap * sizeof(struct handle_name *));
+	struct handle_name **name_of_handle = skynet_malloc(cap * sizeof(struct handle_name *));
+	memset(name, 0, cap * sizeof(struct handle_name *));
+	memset(name_of_handle, 0, cap * sizeof(struct handle_name *));
+	int i;
+	for (i=0;i<s->name_cap;i++) {
+		struct handle_name *n = s->name[i];
+		while (n) {
+			struct handle_name *next = n->next;
+			struct handle_name **slot = &name[n->hash & (cap-1)];
+			n->next = *slot;
+			*slot = n;
+			slot = &name_of_handle[n->handle & (cap-1)];
+			n->hnext = *slot;
+			*slot = n;
+			n = next;
 		}
 	}
-	s->name[before].name = name;
-	s->name[before].handle = handle;
-	s->name_count ++;
+	skynet_free(s->name);
+	skynet_free(s->name_of_handle);
+	s->name = name;
+	s->name_of_handle = name_of_handle;
+	s->name_cap = cap;
 }
 
 static const char *
 _insert_name(struct handle_storage *s, const char * name, uint32_t handle) {
-	int begin = 0;
-	int end = s->name_count - 1;
-	while (begin<=end) {
-		int mid = (begin+end)/2;
-		struct handle_name *n = &s->name[mid];
-		int c = strcmp(n->name, name);
-		if (c==0) {
+	uint32_t hash = name_hash(name);
+	struct handle_name *n = s->name[hash & (s->name_cap-1)];
+	while (n) {
+		if (n->hash == hash && strcmp(n->name, name) == 0) {
 			return NULL;
 		}
-		if (c<0) {
-			begin = mid + 1;
-		} else {
-			end = mid - 1;
-		}
+		n = n->next;
 	}
-	char * result = skynet_strdup(name);
-
-	_insert_name_before(s, result, handle, begin);
+	if (s->name_count >= s->name_cap) {
+		expand_names(s);
+	}
+	n = skynet_malloc(sizeof(*n));
+	n->name = skynet_strdup(name);
+	n->handle = handle;
+	n->hash = hash;
+	struct handle_name **slot = &s->name[hash & (s->name_cap-1)];
+	n->next = *slot;
+	*slot = n;
+	slot = &s->name_of_handle[handle & (s->name_cap-1)];
+	n->hnext = *slot;
+	*slot = n;
+	s->name_count ++;
 
-	return result;
+	return n->name;
 }
 
 const char * 
 skynet_handle_namehandle(uint32_t handle, const char *name) {
-	rwlock_wlock(&H->lock);
+	rwlock_wlock(&H->name_lock);
 
 	const char * ret = _insert_name(H, name, handle);
 
-	rwlock_wunlock(&H->lock);
+	rwlock_wunlock(&H->name_lock);
 
 	return ret;
 }
@@ -257,18 +341,20 @@ void
 skynet_handle_init(int harbor) {
 	assert(H==NULL);
 	struct handle_storage * s = skynet_malloc(sizeof(*H));
-	s->slot_size = DEFAULT_SLOT_SIZE;
-	s->slot = skynet_malloc(s->slot_size * sizeof(struct skynet_context *));
-	memset(s->slot, 0, s->slot_size * sizeof(struct skynet_context *));
+	ATOM_INIT(&s->table, (uintptr_t)new_table(DEFAULT_SLOT_SIZE));
 
 	rwlock_init(&s->lock);
 	// reserve 0 for system
 	s->harbor = (uint32_t) (harbor & 0xff) << HANDLE_REMOTE_SHIFT; // #define HANDLE_REMOTE_SHIFT 24 
 	//<config.harbor>000000000000000000000000 之后会转16进制 <16进制config.harbor>00000000
 	s->handle_index = 1;
-	s->name_cap = 2;
+	rwlock_init(&s->name_lock);
+	s->name_cap = DEFAULT_NAME_SIZE;
 	s->name_count = 0;
-	s->name = skynet_malloc(s->name_cap * sizeof(struct handle_name));
+	s->name = skynet_malloc(s->name_cap * sizeof(struct handle_name *));
+	s->name_of_handle = skynet_malloc(s->name_cap * sizeof(struct handle_name *));
+	memset(s->name, 0, s->name_cap * sizeof(struct handle_name *));
+	memset(s->name_of_handle, 0, s->name_cap * sizeof(struct handle_name *));
 
 	H = s;
 
@@ -12,6 +12,7 @@ struct skynet_context;
 uint32_t skynet_handle_register(struct skynet_context *);
 int skynet_handle_retire(uint32_t handle);
 struct skynet_context * skynet_handle_grab(uint32_t handle);
+int skynet_handle_grab_batch(const uint32_t handles[], int n, struct skynet_context *result[]);
 void skynet_handle_retireall();
 
 uint32_t skynet_handle_findname(const char * name);
@@ -5,11 +5,21 @@ struct skynet_config {
 	int thread;
 	int harbor;
 	int profile;
+	int worksteal;
+	int timeslice;
+	int timer_resolution;
+	int stall_threshold;
+	int monitor_interval;
+	int socket_thread;
 	const char * daemon;
 	const char * module_path;
 	const char * bootstrap;
 	const char * logger;
 	const char * logservice;
+	const char * affinity_worker;
+	const char * affinity_socket;
+	const char * affinity_timer;
+	const char * affinity_monitor;
 };
 
 #define THREAD_WORKER 0
@@ -160,6 +160,16 @@ main(int argc, char *argv[]) {
 	config.logger = optstring("logger", NULL);
 	config.logservice = optstring("logservice", "logger");
 	config.profile = optboolean("profile", 1); //默认为 true, 可以用来统计每个服务使用了多少 cpu 时间。
+	config.worksteal = optboolean("worksteal", 0); //每个工作线程一个本地队列，空闲时互相偷取
+	config.timeslice = optint("timeslice", 0); //微秒，大于 0 时按时间片决定每次处理多少条消息，0 用 weight 表
+	config.timer_resolution = optint("timer_resolution", 10); //毫秒，时间轮一个刻度的长度，1/2/5/10
+	config.stall_threshold = optint("stall_threshold", 0); //毫秒，一条消息处理超过它就记一次卡顿并抓 lua traceback，0 不检测
+	config.monitor_interval = optint("monitor_interval", 0); //毫秒，monitor 线程检查的间隔，0 按 stall_threshold 自动选
+	config.socket_thread = optint("socket_thread", 1); //socket 线程数，每个线程一个 socket_server，连接分散到各线程
+	config.affinity_worker = optstring("affinity_worker", NULL); //线程绑核的 cpu 列表，见 skynet_affinity.c
+	config.affinity_socket = optstring("affinity_socket", NULL);
+	config.affinity_timer = optstring("affinity_timer", NULL);
+	config.affinity_monitor = optstring("affinity_monitor", NULL);
 
 	lua_close(L);
 
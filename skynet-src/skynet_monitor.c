@@ -3,22 +3,147 @@
 #include "skynet_monitor.h"
 #include "skynet_server.h"
 #include "skynet.h"
+#include "spinlock.h"
 #include "atomic.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+#define ENDLESS_TIME 5000	// ms
+#define STALL_HISTORY 64
+
+/*
+monitor 线程每 interval 毫秒检查一次每个工作线程：version 没变并且还在处理消息，就说明这条消息至少跑了 (now - since) 毫秒。
+超过 stall 阈值时记一条卡顿，并给这个服务发 signal 2，snlua 会在下一条 lua 指令处把 traceback 填进这条记录，不打断它。
+卡在 C 函数里的消息可能在下一条 lua 指令之前就返回了，这时 trap 落在同一服务的下一条消息上，version 对不上，traceback 丢掉。
+超过 ENDLESS_TIME 时和以前一样报 endless loop。最近 STALL_HISTORY 条卡顿放在环形缓冲里，见 skynet_stall_history。
+*/
+
 struct skynet_monitor {
 	ATOM_INT version;
 	int check_version;
 	uint32_t source;
 	uint32_t destination;
+	uint64_t since;	// skynet_now_ms() when check_version is seen first
+	int stall;	// index of the stall report of current message, -1 for none
+	uint64_t endless;	// next time to report endless loop
+};
+
+// the message a stall report belongs to : the monitor of the worker and its version when it's found
+struct stall_owner {
+	struct skynet_monitor *sm;
+	int version;
 };
 
+struct stall_history {
+	struct spinlock lock;
+	int stall;	// threshold in ms, 0 for off
+	int interval;
+	int n;	// total reports
+	struct skynet_stall r[STALL_HISTORY];
+	struct stall_owner owner[STALL_HISTORY];
+};
+
+static struct stall_history H;
+
+// the monitor of the worker thread, set by skynet_monitor_trigger
+static __thread struct skynet_monitor * current_monitor = NULL;
+
+void
+skynet_monitor_init(int stall, int interval) {
+	memset(&H, 0, sizeof(H));
+	SPIN_INIT(&H);
+	H.stall = stall > 0 ? stall : 0;
+	if (interval <= 0) {
+		interval = 1000;
+		if (H.stall > 0) {
+			// find the stall in about 1/4 of it
+			interval = H.stall / 4;
+			if (interval < 10)
+				interval = 10;
+			else if (interval > 1000)
+				interval = 1000;
+		}
+	}
+	H.interval = interval;
+}
+
+int
+skynet_monitor_interval(void) {
+	return H.interval;
+}
+
+static int
+stall_report(struct skynet_monitor *sm, int version, uint32_t source, uint32_t destination, uint32_t duration) {
+	SPIN_LOCK(&H);
+	int index = H.n++;
+	struct skynet_stall *r = &H.r[index % STALL_HISTORY];
+	H.owner[index % STALL_HISTORY].sm = sm;
+	H.owner[index % STALL_HISTORY].version = version;
+	r->time = skynet_now_ms();
+	r->source = source;
+	r->destination = destination;
+	r->duration = duration;
+	r->trace[0] = '\0';
+	SPIN_UNLOCK(&H);
+	return index;
+}
+
+static void
+stall_update(int index, uint32_t duration) {
+	SPIN_LOCK(&H);
+	if (H.n - index <= STALL_HISTORY) {
+		H.r[index % STALL_HISTORY].duration = duration;
+	}
+	SPIN_UNLOCK(&H);
+}
+
+int
+skynet_stall_traceback(struct skynet_context *ctx, const char *trace) {
+	struct skynet_monitor *sm = current_monitor;
+	if (sm == NULL)
+		return 0;
+	// the stalled message may have returned before the trap fires, then it's another message of the service
+	int version = ATOM_LOAD(&sm->version);
+	uint32_t handle = skynet_context_handle(ctx);
+	int ret = 0;
+	SPIN_LOCK(&H);
+	int i;
+	for (i=H.n-1;i>=0 && H.n-i<=STALL_HISTORY;i--) {
+		struct skynet_stall *r = &H.r[i % STALL_HISTORY];
+		struct stall_owner *o = &H.owner[i % STALL_HISTORY];
+		if (r->destination == handle && o->sm == sm && o->version == version) {
+			if (r->trace[0] == '\0') {
+				strncpy(r->trace, trace, sizeof(r->trace) - 1);
+				r->trace[sizeof(r->trace) - 1] = '\0';
+				ret = 1;
+			}
+			break;
+		}
+	}
+	SPIN_UNLOCK(&H);
+	return ret;
+}
+
+int
+skynet_stall_history(struct skynet_stall *buffer, int n) {
+	SPIN_LOCK(&H);
+	int count = H.n < STALL_HISTORY ? H.n : STALL_HISTORY;
+	if (n > count)
+		n = count;
+	int i;
+	for (i=0;i<n;i++) {
+		buffer[i] = H.r[(H.n - n + i) % STALL_HISTORY];
+	}
+	SPIN_UNLOCK(&H);
+	return n;
+}
+
 struct skynet_monitor * 
 skynet_monitor_new() {
 	struct skynet_monitor * ret = skynet_malloc(sizeof(*ret));
 	memset(ret, 0, sizeof(*ret));
+	ret->stall = -1;
 	return ret;
 }
 
@@ -30,6 +155,7 @@ skynet_monitor_delete(struct skynet_monitor *sm) {
 //处理消息的时候赋值destination，处理完置0
 void 
 skynet_monitor_trigger(struct skynet_monitor *sm, uint32_t source, uint32_t destination) {
+	current_monitor = sm;
 	sm->source = source;
 	sm->destination = destination;
 	ATOM_FINC(&sm->version);
@@ -37,12 +163,32 @@ skynet_monitor_trigger(struct skynet_monitor *sm, uint32_t source, uint32_t dest
 
 void 
 skynet_monitor_check(struct skynet_monitor *sm) {
-	if (sm->version == sm->check_version) {
-		if (sm->destination) { //在处理消息，并且一直是同一个(在thread_monitor中现在是5秒一检测)
-			skynet_context_endless(sm->destination); //通知消息堵住了
-			skynet_error(NULL, "A message from [ :%08x ] to [ :%08x ] maybe in an endless loop (version = %d)", sm->source , sm->destination, sm->version);
+	int version = ATOM_LOAD(&sm->version);
+	uint64_t now = skynet_now_ms();
+	if (version != sm->check_version) {
+		sm->check_version = version;
+		sm->since = now;
+		sm->stall = -1;
+		sm->endless = now + ENDLESS_TIME;
+		return;
+	}
+	uint32_t destination = sm->destination;
+	if (destination == 0) //在处理消息，并且一直是同一个
+		return;
+	uint32_t duration = (uint32_t)(now - sm->since);
+	if (H.stall > 0 && duration >= H.stall) {
+		if (sm->stall < 0) {
+			sm->stall = stall_report(sm, version, sm->source, destination, duration);
+			skynet_error(NULL, "A message from [ :%08x ] to [ :%08x ] stalls for %u ms (version = %d)", sm->source, destination, duration, version);
+			// ask snlua for a traceback
+			skynet_context_signal(destination, 2);
+		} else {
+			stall_update(sm->stall, duration);
 		}
-	} else {
-		sm->check_version = sm->version;
+	}
+	if (now >= sm->endless) {
+		sm->endless = now + ENDLESS_TIME;
+		skynet_context_endless(destination); //通知消息堵住了
+		skynet_error(NULL, "A message from [ :%08x ] to [ :%08x ] maybe in an endless loop (version = %d)", sm->source , destination, version);
 	}
 }
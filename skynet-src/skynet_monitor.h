@@ -5,6 +5,10 @@
 
 struct skynet_monitor;
 
+// stall : report a message running longer than it (ms), 0 to report the endless loop only
+// interval : check every interval ms, 0 means choose it by stall
+void skynet_monitor_init(int stall, int interval);
+int skynet_monitor_interval(void);	// in ms
 struct skynet_monitor * skynet_monitor_new();
 void skynet_monitor_delete(struct skynet_monitor *);
 void skynet_monitor_trigger(struct skynet_monitor *, uint32_t source, uint32_t destination);
@@ -1,13 +1,17 @@
 #include "skynet.h"
 #include "skynet_mq.h"
 #include "skynet_handle.h"
+#include "skynet_timer.h"
 #include "spinlock.h"
+#include "atomic.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <pthread.h>
+
 
 #define DEFAULT_QUEUE_SIZE 64
 #define MAX_GLOBAL_MQ 0x10000
@@ -18,6 +22,10 @@
 #define MQ_IN_GLOBAL 1
 #define MQ_OVERLOAD 1024
 
+// 高优先级通道连续取这么多条后，普通通道不空就让它取一条，避免饿死
+#define MQ_HIGH_BURST 8
+#define DEFAULT_HIGH_QUEUE_SIZE 16
+
 /*skynet包含两级消息队列，一个global_mq，他包含一个head和tail指针，分别指向次级消息队列的头部和尾部，
 另外还有一个次级消息队列，这个一个单向链表。
 消息的派发机制是，工作线程，会从global_mq里pop一个次级消息队列来，然后从次级消息队列中，pop出一个消息，
@@ -43,48 +51,388 @@ pop 时 length == 0 ，队列空了，初始化过载保护值
 tail 追上 head，说明满了，扩容；head 追上 tail，说明空了，over 不用再处理了
 */
 
+/*
+每个次级消息队列分两条通道：PTYPE_RESPONSE / PTYPE_SYSTEM / PTYPE_ERROR 走高优先级通道，其余走普通通道。
+服务过载时，回应和定时器唤醒不用排在成千上万的请求后面，等它们的协程能尽快继续，不会越堵越多。
+同一条通道内仍然保序。
+*/
+
+static inline int
+lane_of(struct skynet_message *message) {
+	switch (message->sz >> MESSAGE_TYPE_SHIFT) {
+	case PTYPE_RESPONSE:
+	case PTYPE_SYSTEM:
+	case PTYPE_ERROR:
+		return MQ_LANE_HIGH;
+	default:
+		return MQ_LANE_NORMAL;
+	}
+}
+
+/*
+邮箱上限只限制普通通道：高优先级通道里是回应和错误消息，丢了会让对方的协程永远等下去。
+被拒绝或挤掉的消息交给 skynet_mq_overflow 设置的钩子处理 (释放并告诉发送方)。
+*/
+
+#define MQ_ACCEPT 0
+#define MQ_REJECT 1
+#define MQ_EVICT 2
+
+static inline int
+limit_action(int limit, int policy, uint32_t shed, int length, struct skynet_message *message) {
+	if (limit <= 0 || length < limit) {
+		return MQ_ACCEPT;
+	}
+	switch (policy) {
+	case MQ_POLICY_DROPOLD:
+		return MQ_EVICT;
+	case MQ_POLICY_SHED: {
+		int type = message->sz >> MESSAGE_TYPE_SHIFT;
+		if (type < 32 && (shed & (1u << type))) {
+			return MQ_REJECT;
+		}
+		return MQ_ACCEPT;
+	}
+	default:
+		return MQ_REJECT;
+	}
+}
+
+#ifdef USE_LOCKFREE_MQ
+
+/*
+USE_LOCKFREE_MQ 时次级消息队列换成无锁的多生产者/单消费者队列：
+由固定大小的 segment 串成单向链表，生产者用原子自增在 tail segment 里抢一个槽位写入，
+满了就链上（或者跟随）下一个 segment；消费者只有持有该队列的那个工作线程，按顺序读槽位。
+in_global 仍然表示在全局队列里或正在派发，由 CAS 决定谁把它放回全局队列。
+消费完的 segment 先挂在 retired 上，等没有生产者在 push 中 (inflight == 0) 时才回收，
+因为迟到的生产者可能还拿着旧的 tail 指针。
+*/
+
+#define MQ_SEGMENT_SIZE 64
+
+struct mq_slot {
+	ATOM_INT ready;
+	struct skynet_message msg;
+};
+
+struct mq_segment {
+	ATOM_POINTER next;
+	ATOM_INT alloc; // 已被生产者占用的槽位数，可能超过 MQ_SEGMENT_SIZE
+	uint64_t base; // slot[0] 在整条队列里的序号
+	struct mq_segment *retire;
+	struct mq_slot slot[MQ_SEGMENT_SIZE];
+};
+
+struct mq_lane {
+	ATOM_POINTER tail; // struct mq_segment *
+	// 以下只有消费者访问
+	struct mq_segment *head;
+	int head_slot;
+};
+
 struct message_queue {
-	struct spinlock lock; //// 自旋锁，可能存在多个线程，向同一个队列写入的情况，加上自旋锁避免并发带来的风险
-	uint32_t handle; // 拥有此消息队列的服务的id
+	uint32_t handle;
+	ATOM_INT release;
+	ATOM_INT in_global;
+	ATOM_INT inflight; // 正在 push 的生产者数
+	ATOM_POINTER spare; // 回收给生产者复用的 segment
+	ATOM_INT limit;
+	ATOM_INT popped; // 普通通道已取出的序号 (低 32 位)，生产者用它估算长度
+	ATOM_INT dropped;
+	int policy;
+	uint32_t shed;
+	struct mq_lane lane[MQ_LANES];
+	// 以下只有消费者访问
+	struct mq_segment *retired;
+	int high_burst;
+	int overload;
+	int overload_threshold;
+	struct message_queue *next;
+};
+
+#else
+
+struct mq_ring {
+	int size; // 初始大小，突发过后缩回去
 	int cap; // 消息大小
 	int head;
 	int tail;
+	struct skynet_message *queue; //消息数组
+};
+
+struct message_queue {
+	struct spinlock lock; //// 自旋锁，可能存在多个线程，向同一个队列写入的情况，加上自旋锁避免并发带来的风险
+	uint32_t handle; // 拥有此消息队列的服务的id
 	int release; // 是否能释放消息
 	int in_global; // 是否在全局消息队列中，0表示不是，1表示是
 	int overload; //过载消息数
 	int overload_threshold; //超这个值过载保护
-	struct skynet_message *queue; //消息数组
+	int high_burst; // 连续从高优先级通道取出的消息数
+	int limit; // 普通通道的上限，0 不限
+	int policy;
+	uint32_t shed;
+	int dropped;
+	struct mq_ring lane[MQ_LANES];
 	struct message_queue *next; // 下一个次级消息队列的指针
 };
 
+#endif
+
 struct global_queue {
 	struct message_queue *head;
 	struct message_queue *tail;
+	int count; // 只在锁内修改，skynet_globalmq_length 不加锁读，只是个估计值
 	struct spinlock lock;
 };
 
+/*
+work steal 模式下每个工作线程有自己的本地队列，worker 线程让服务变为可运行时放进自己的本地队列，
+空闲时先取本地队列，再取全局队列，最后从别的 worker 的本地队列偷一半。
+global_queue 仍然保留，给 socket/timer/main 等非 worker 线程注入用。
+*/
+struct local_queue {
+	struct message_queue *head;
+	struct message_queue *tail;
+	ATOM_INT count;
+	int tick; // 只有所属 worker 访问，定期先看全局队列，避免全局队列饿死
+	int node; // numa 节点，-1 未知
+	struct spinlock lock;
+};
+
+// 每取 GLOBAL_FIRST_TICK 次，优先取一次全局队列
+#define GLOBAL_FIRST_TICK 61
+
 static struct global_queue *Q = NULL;
+static void (*WAKEUP)(void *) = NULL;
+static void *WAKEUP_UD = NULL;
+static void (*OVERFLOW)(uint32_t handle, struct skynet_message *msg) = NULL;
+static struct local_queue *LQ = NULL;
+static int LQ_COUNT = 0;
+static pthread_key_t LQ_KEY;
+
+static inline struct local_queue *
+current_local() {
+	if (LQ == NULL)
+		return NULL;
+	return pthread_getspecific(LQ_KEY);
+}
+
+static void
+local_push(struct local_queue *lq, struct message_queue *queue) {
+	SPIN_LOCK(lq)
+	assert(queue->next == NULL);
+	if(lq->tail) {
+		lq->tail->next = queue;
+		lq->tail = queue;
+	} else {
+		lq->head = lq->tail = queue;
+	}
+	ATOM_FINC(&lq->count);
+	SPIN_UNLOCK(lq)
+}
+
+static struct message_queue *
+local_pop(struct local_queue *lq) {
+	if (ATOM_LOAD(&lq->count) == 0)
+		return NULL;
+	SPIN_LOCK(lq)
+	struct message_queue *mq = lq->head;
+	if(mq) {
+		lq->head = mq->next;
+		if(lq->head == NULL) {
+			assert(mq == lq->tail);
+			lq->tail = NULL;
+		}
+		mq->next = NULL;
+		ATOM_FDEC(&lq->count);
+	}
+	SPIN_UNLOCK(lq)
+	return mq;
+}
+
+// 从 victim 偷走前一半，返回第一个，其余放进 self
+static struct message_queue *
+local_steal(struct local_queue *self, struct local_queue *victim) {
+	if (ATOM_LOAD(&victim->count) == 0)
+		return NULL;
+	SPIN_LOCK(victim)
+	struct message_queue *head = victim->head;
+	if (head == NULL) {
+		SPIN_UNLOCK(victim)
+		return NULL;
+	}
+	int n = (ATOM_LOAD(&victim->count) + 1) / 2;
+	struct message_queue *last = head;
+	int i;
+	for (i=1;i<n;i++) {
+		last = last->next;
+	}
+	victim->head = last->next;
+	if (victim->head == NULL) {
+		victim->tail = NULL;
+	}
+	last->next = NULL;
+	ATOM_FSUB(&victim->count, n);
+	SPIN_UNLOCK(victim)
+
+	struct message_queue *mq = head->next;
+	head->next = NULL;
+	while (mq) {
+		struct message_queue *next = mq->next;
+		mq->next = NULL;
+		local_push(self, mq);
+		mq = next;
+	}
+	return head;
+}
+
+static struct message_queue * globalmq_pop(struct global_queue *q);
+
+static struct message_queue *
+localmq_pop(struct local_queue *lq) {
+	struct message_queue *mq;
+	if (++lq->tick >= GLOBAL_FIRST_TICK) {
+		lq->tick = 0;
+		mq = globalmq_pop(Q);
+		if (mq)
+			return mq;
+	}
+	mq = local_pop(lq);
+	if (mq)
+		return mq;
+	mq = globalmq_pop(Q);
+	if (mq)
+		return mq;
+	int id = lq - LQ;
+	int pass, i;
+	// 先偷同一个 numa 节点的，再偷其它节点的
+	for (pass=0;pass<2;pass++) {
+		for (i=1;i<LQ_COUNT;i++) {
+			struct local_queue *victim = &LQ[(id + i) % LQ_COUNT];
+			if ((victim->node == lq->node) != (pass == 0))
+				continue;
+			mq = local_steal(lq, victim);
+			if (mq)
+				return mq;
+		}
+	}
+	return NULL;
+}
+
+void
+skynet_globalmq_worksteal(int worker, const int node[]) {
+	assert(LQ == NULL);
+	struct local_queue *lq = skynet_malloc(worker * sizeof(*lq));
+	memset(lq, 0, worker * sizeof(*lq));
+	int i;
+	for (i=0;i<worker;i++) {
+		ATOM_INIT(&lq[i].count, 0);
+		lq[i].node = node ? node[i] : -1;
+		SPIN_INIT(&lq[i]);
+	}
+	if (pthread_key_create(&LQ_KEY, NULL)) {
+		fprintf(stderr, "pthread_key_create failed");
+		exit(1);
+	}
+	LQ_COUNT = worker;
+	LQ = lq;
+}
+
+void
+skynet_globalmq_bindworker(int id) {
+	if (LQ == NULL)
+		return;
+	assert(id >= 0 && id < LQ_COUNT);
+	pthread_setspecific(LQ_KEY, &LQ[id]);
+}
+
+void
+skynet_globalmq_wakeup(void (*wakeup)(void *ud), void *ud) {
+	WAKEUP_UD = ud;
+	WAKEUP = wakeup;
+}
 
 void 
 skynet_globalmq_push(struct message_queue * queue) {
-	struct global_queue *q= Q;
+	struct local_queue *lq = current_local();
+	if (lq) {
+		local_push(lq, queue);
+	} else {
+		struct global_queue *q= Q;
 
-	SPIN_LOCK(q)
-	assert(queue->next == NULL);
-	if(q->tail) {
-		q->tail->next = queue;
-		q->tail = queue;
+		SPIN_LOCK(q)
+		assert(queue->next == NULL);
+		if(q->tail) {
+			q->tail->next = queue;
+			q->tail = queue;
+		} else {
+			q->head = q->tail = queue;
+		}
+		++q->count;
+		SPIN_UNLOCK(q)
+	}
+	// 有工作线程在睡就叫醒一个
+	if (WAKEUP) {
+		WAKEUP(WAKEUP_UD);
+	}
+}
+
+// 把一串队列一次接到本地队列或全局队列的尾部
+void
+skynet_globalmq_pushbatch(struct message_queue *queue[], int n) {
+	if (n <= 0)
+		return;
+	int i;
+	for (i=0;i<n;i++) {
+		assert(queue[i]->next == NULL);
+		queue[i]->next = (i+1 < n) ? queue[i+1] : NULL;
+	}
+	struct message_queue *head = queue[0];
+	struct message_queue *tail = queue[n-1];
+	struct local_queue *lq = current_local();
+	if (lq) {
+		SPIN_LOCK(lq)
+		if (lq->tail) {
+			lq->tail->next = head;
+		} else {
+			lq->head = head;
+		}
+		lq->tail = tail;
+		ATOM_FADD(&lq->count, n);
+		SPIN_UNLOCK(lq)
 	} else {
-		q->head = q->tail = queue;
+		struct global_queue *q = Q;
+		SPIN_LOCK(q)
+		if (q->tail) {
+			q->tail->next = head;
+		} else {
+			q->head = head;
+		}
+		q->tail = tail;
+		q->count += n;
+		SPIN_UNLOCK(q)
+	}
+	if (WAKEUP) {
+		for (i=0;i<n;i++) {
+			WAKEUP(WAKEUP_UD);
+		}
 	}
-	SPIN_UNLOCK(q)
 }
 
 struct message_queue * 
 skynet_globalmq_pop() {
-	struct global_queue *q = Q;
+	struct local_queue *lq = current_local();
+	if (lq) {
+		return localmq_pop(lq);
+	}
+	return globalmq_pop(Q);
+}
 
+static struct message_queue *
+globalmq_pop(struct global_queue *q) {
 	SPIN_LOCK(q)
+
 	struct message_queue *mq = q->head;
 	if(mq) {
 		q->head = mq->next; //头指向下一个
@@ -93,19 +441,84 @@ skynet_globalmq_pop() {
 			q->tail = NULL;
 		}
 		mq->next = NULL;
+		--q->count;
 	}
 	SPIN_UNLOCK(q)
 
 	return mq;
 }
 
+int
+skynet_globalmq_length(void) {
+	int n = ((volatile struct global_queue *)Q)->count;
+	int i;
+	for (i=0;i<LQ_COUNT;i++) {
+		n += ATOM_LOAD(&LQ[i].count);
+	}
+	return n;
+}
+
+uint32_t 
+skynet_mq_handle(struct message_queue *q) {
+	return q->handle;
+}
+
+//过载，消息太多了
+int
+skynet_mq_overload(struct message_queue *q) {
+	if (q->overload) {
+		int overload = q->overload;
+		q->overload = 0;
+		return overload;
+	} 
+	return 0;
+}
+
+void
+skynet_mq_overflow(void (*overflow)(uint32_t handle, struct skynet_message *msg)) {
+	OVERFLOW = overflow;
+}
+
+static void
+overflow(struct message_queue *q, struct skynet_message *msg) {
+	if (OVERFLOW) {
+		OVERFLOW(q->handle, msg);
+	} else {
+		skynet_free(msg->data);
+	}
+}
+
+void 
+skynet_mq_init() {
+	struct global_queue *q = skynet_malloc(sizeof(*q));
+	memset(q,0,sizeof(*q));
+	SPIN_INIT(q);
+	Q=q;
+}
+
+#ifndef USE_LOCKFREE_MQ
+
+static void
+ring_init(struct mq_ring *r, int cap) {
+	r->size = cap;
+	r->cap = cap;
+	r->head = 0;
+	r->tail = 0;
+	r->queue = skynet_malloc(sizeof(struct skynet_message) * cap);
+}
+
+static inline int
+ring_length(struct mq_ring *r) {
+	if (r->head <= r->tail) {
+		return r->tail - r->head;
+	}
+	return r->tail + r->cap - r->head;
+}
+
 struct message_queue * 
 skynet_mq_create(uint32_t handle) {
 	struct message_queue *q = skynet_malloc(sizeof(*q));
 	q->handle = handle;
-	q->cap = DEFAULT_QUEUE_SIZE;
-	q->head = 0;
-	q->tail = 0;
 	SPIN_INIT(q)
 	// When the queue is create (always between service create and service init) ,
 	// set in_global flag to avoid push it to global queue .
@@ -114,7 +527,13 @@ skynet_mq_create(uint32_t handle) {
 	q->release = 0;
 	q->overload = 0; //当前过载消息数
 	q->overload_threshold = MQ_OVERLOAD; //消息数超过这么多将保护
-	q->queue = skynet_malloc(sizeof(struct skynet_message) * q->cap); //默认64条消息
+	q->high_burst = 0;
+	q->limit = 0;
+	q->policy = MQ_POLICY_REJECT;
+	q->shed = 0;
+	q->dropped = 0;
+	ring_init(&q->lane[MQ_LANE_HIGH], DEFAULT_HIGH_QUEUE_SIZE);
+	ring_init(&q->lane[MQ_LANE_NORMAL], DEFAULT_QUEUE_SIZE); //默认64条消息
 	q->next = NULL;
 
 	return q;
@@ -124,40 +543,83 @@ static void
 _release(struct message_queue *q) {
 	assert(q->next == NULL);
 	SPIN_DESTROY(q)
-	skynet_free(q->queue);
+	int i;
+	for (i=0;i<MQ_LANES;i++) {
+		skynet_free(q->lane[i].queue);
+	}
 	skynet_free(q);
 }
 
-uint32_t 
-skynet_mq_handle(struct message_queue *q) {
-	return q->handle;
+int
+skynet_mq_lane_length(struct message_queue *q, int lane) {
+	assert(lane >= 0 && lane < MQ_LANES);
+	int length;
+	SPIN_LOCK(q)
+	length = ring_length(&q->lane[lane]);
+	SPIN_UNLOCK(q)
+	return length;
 }
 
 int
 skynet_mq_length(struct message_queue *q) {
-	int head, tail,cap;
+	int length = 0;
+	int i;
 
 	SPIN_LOCK(q)
-	head = q->head;
-	tail = q->tail;
-	cap = q->cap;
+	for (i=0;i<MQ_LANES;i++) {
+		length += ring_length(&q->lane[i]);
+	}
 	SPIN_UNLOCK(q)
 	
-	if (head <= tail) {
-		return tail - head;
-	}
-	return tail + cap - head;
+	return length;
+}
+
+void
+skynet_mq_limit(struct message_queue *q, int limit, int policy, uint32_t shed) {
+	SPIN_LOCK(q)
+	q->limit = limit;
+	q->policy = policy;
+	q->shed = shed;
+	SPIN_UNLOCK(q)
 }
 
-//过载，消息太多了
 int
-skynet_mq_overload(struct message_queue *q) {
-	if (q->overload) {
-		int overload = q->overload;
-		q->overload = 0;
-		return overload;
-	} 
-	return 0;
+skynet_mq_dropped(struct message_queue *q) {
+	return ((volatile struct message_queue *)q)->dropped;
+}
+
+// 高优先级通道优先，连续取了 MQ_HIGH_BURST 条以后普通通道有消息就取一条普通的
+static struct mq_ring *
+select_lane(struct message_queue *q) {
+	struct mq_ring *high = &q->lane[MQ_LANE_HIGH];
+	struct mq_ring *normal = &q->lane[MQ_LANE_NORMAL];
+	int has_normal = normal->head != normal->tail;
+	if (high->head != high->tail && (q->high_burst < MQ_HIGH_BURST || !has_normal)) {
+		if (q->high_burst < MQ_HIGH_BURST) {
+			++q->high_burst;
+		}
+		return high;
+	}
+	q->high_burst = 0;
+	return has_normal ? normal : NULL;
+}
+
+// 长度不到 cap/8 时减半，和扩容之间留出余量，避免在边界上反复分配
+static void
+shrink_queue(struct mq_ring *r) {
+	int cap = r->cap / 2;
+	int length = ring_length(r);
+	struct skynet_message *new_queue = skynet_malloc(sizeof(struct skynet_message) * cap);
+	int i;
+	for (i=0;i<length;i++) {
+		new_queue[i] = r->queue[(r->head + i) % r->cap];
+	}
+	r->head = 0;
+	r->tail = length;
+	r->cap = cap;
+
+	skynet_free(r->queue);
+	r->queue = new_queue;
 }
 
 int
@@ -165,19 +627,21 @@ skynet_mq_pop(struct message_queue *q, struct skynet_message *message) {
 	int ret = 1;
 	SPIN_LOCK(q)
 
-	if (q->head != q->tail) {
-		*message = q->queue[q->head++];
+	struct mq_ring *r = select_lane(q);
+	if (r) {
+		*message = r->queue[r->head++];
 		ret = 0;
-		int head = q->head;
-		int tail = q->tail;
-		int cap = q->cap;
 
-		if (head >= cap) {
-			q->head = head = 0;
+		if (r->head >= r->cap) {
+			r->head = 0;
 		}
-		int length = tail - head;
-		if (length < 0) { // head 在后，tail 在前
-			length += cap; // (-length) 表示 tail 和 head 间的那段，未使用的消息的数量
+		if (r->cap > r->size && ring_length(r) < r->cap / 8) {
+			shrink_queue(r); // 突发过去了，把内存还回去
+		}
+		int length = 0;
+		int i;
+		for (i=0;i<MQ_LANES;i++) {
+			length += ring_length(&q->lane[i]);
 		}
 		while (length > q->overload_threshold) { //过载保护了，超1024*n了
 			q->overload = length;
@@ -198,59 +662,491 @@ skynet_mq_pop(struct message_queue *q, struct skynet_message *message) {
 }
 
 static void
-expand_queue(struct message_queue *q) {
-	struct skynet_message *new_queue = skynet_malloc(sizeof(struct skynet_message) * q->cap * 2);
+expand_queue(struct mq_ring *r) {
+	struct skynet_message *new_queue = skynet_malloc(sizeof(struct skynet_message) * r->cap * 2);
 	int i;
-	for (i=0;i<q->cap;i++) {
-		new_queue[i] = q->queue[(q->head + i) % q->cap];
+	for (i=0;i<r->cap;i++) {
+		new_queue[i] = r->queue[(r->head + i) % r->cap];
 	}
-	q->head = 0;
-	q->tail = q->cap;
-	q->cap *= 2;
+	r->head = 0;
+	r->tail = r->cap;
+	r->cap *= 2;
 	
-	skynet_free(q->queue);
-	q->queue = new_queue;
+	skynet_free(r->queue);
+	r->queue = new_queue;
 }
 
-void 
-skynet_mq_push(struct message_queue *q, struct skynet_message *message) {
+static inline void
+ring_push(struct mq_ring *r, struct skynet_message *message) {
+	r->queue[r->tail] = *message;
+	if (++ r->tail >= r->cap) {
+		r->tail = 0; //回绕
+	}
+
+	if (r->head == r->tail) {
+		expand_queue(r); //扩容
+	}
+}
+
+int
+skynet_mq_push_pending(struct message_queue *q, struct skynet_message *message) {
 	assert(message);
+	message->stamp = skynet_hpc();
+	int runnable = 0;
+	int lane = lane_of(message);
+	struct mq_ring *r = &q->lane[lane];
+	struct skynet_message drop;
+	int action = MQ_ACCEPT;
 	SPIN_LOCK(q) //自旋，循环尝试插入
 
-	q->queue[q->tail] = *message;
-	if (++ q->tail >= q->cap) {
-		q->tail = 0; //回绕
+	if (lane == MQ_LANE_NORMAL && q->limit > 0) {
+		action = limit_action(q->limit, q->policy, q->shed, ring_length(r), message);
+		if (action == MQ_REJECT) {
+			++q->dropped;
+			SPIN_UNLOCK(q)
+			overflow(q, message);
+			return 0;
+		} else if (action == MQ_EVICT) {
+			// 挤掉最老的一条，空出的位置正好给新消息
+			drop = r->queue[r->head];
+			if (++ r->head >= r->cap) {
+				r->head = 0;
+			}
+			++q->dropped;
+		}
 	}
 
-	if (q->head == q->tail) {
-		expand_queue(q); //扩容
-	}
+	ring_push(r, message);
 
 	if (q->in_global == 0) {
 		q->in_global = MQ_IN_GLOBAL;
-		skynet_globalmq_push(q);
+		runnable = 1;
 	}
 	
 	SPIN_UNLOCK(q)
+
+	if (action == MQ_EVICT) {
+		overflow(q, &drop);
+	}
+	return runnable;
 }
 
-void 
-skynet_mq_init() {
-	struct global_queue *q = skynet_malloc(sizeof(*q));
-	memset(q,0,sizeof(*q));
-	SPIN_INIT(q);
-	Q=q;
+int
+skynet_mq_push_pending_n(struct message_queue *q, struct skynet_message message[], int n) {
+	int runnable = 0;
+	int i;
+	uint64_t stamp = skynet_hpc();
+	for (i=0;i<n;i++) {
+		message[i].stamp = stamp;
+	}
+	i = 0;
+	while (i < n) {
+		int pushed = 0;
+		SPIN_LOCK(q)
+		for (;i<n;i++) {
+			int lane = lane_of(&message[i]);
+			if (lane == MQ_LANE_NORMAL && q->limit > 0) {
+				// may be rejected or evict one, leave it to skynet_mq_push_pending
+				break;
+			}
+			ring_push(&q->lane[lane], &message[i]);
+			pushed = 1;
+		}
+		if (pushed && q->in_global == 0) {
+			q->in_global = MQ_IN_GLOBAL;
+			runnable = 1;
+		}
+		SPIN_UNLOCK(q)
+		if (i < n) {
+			runnable |= skynet_mq_push_pending(q, &message[i]);
+			++i;
+		}
+	}
+	return runnable;
 }
 
 void 
 skynet_mq_mark_release(struct message_queue *q) {
+	int push = 0;
 	SPIN_LOCK(q)
 	assert(q->release == 0);
 	q->release = 1;
 	if (q->in_global != MQ_IN_GLOBAL) {
-		skynet_globalmq_push(q);
+		// 和 skynet_mq_push 一样，先占住 in_global，出锁以后再放进全局队列（wakeup 可能阻塞）
+		q->in_global = MQ_IN_GLOBAL;
+		push = 1;
 	}
 	SPIN_UNLOCK(q)
+	if (push) {
+		skynet_globalmq_push(q);
+	}
+}
+
+#else
+
+static struct mq_segment *
+new_segment() {
+	struct mq_segment *seg = skynet_malloc(sizeof(*seg));
+	ATOM_INIT(&seg->next, (uintptr_t)NULL);
+	ATOM_INIT(&seg->alloc, 0);
+	seg->base = 0;
+	seg->retire = NULL;
+	int i;
+	for (i=0;i<MQ_SEGMENT_SIZE;i++) {
+		ATOM_INIT(&seg->slot[i].ready, 0);
+	}
+	return seg;
+}
+
+// 槽位的 ready 在 pop 时已经清零
+static void
+recycle_segment(struct message_queue *q, struct mq_segment *seg) {
+	ATOM_STORE(&seg->next, (uintptr_t)NULL);
+	ATOM_STORE(&seg->alloc, 0);
+	seg->retire = NULL;
+	uintptr_t exp = (uintptr_t)NULL;
+	if (!ATOM_CAS_POINTER(&q->spare, exp, (uintptr_t)seg)) {
+		skynet_free(seg);
+	}
+}
+
+// 只在 inflight 期间调用，此时 spare 不会被消费者换掉
+static struct mq_segment *
+take_segment(struct message_queue *q) {
+	uintptr_t seg = ATOM_LOAD(&q->spare);
+	while (seg) {
+		if (ATOM_CAS_POINTER(&q->spare, seg, (uintptr_t)NULL)) {
+			return (struct mq_segment *)seg;
+		}
+	}
+	return new_segment();
+}
+
+struct message_queue *
+skynet_mq_create(uint32_t handle) {
+	struct message_queue *q = skynet_malloc(sizeof(*q));
+	q->handle = handle;
+	// see the comment of the spinlock version
+	ATOM_INIT(&q->in_global, MQ_IN_GLOBAL);
+	ATOM_INIT(&q->release, 0);
+	ATOM_INIT(&q->inflight, 0);
+	ATOM_INIT(&q->spare, (uintptr_t)NULL);
+	ATOM_INIT(&q->limit, 0);
+	ATOM_INIT(&q->popped, 0);
+	ATOM_INIT(&q->dropped, 0);
+	q->policy = MQ_POLICY_REJECT;
+	q->shed = 0;
+	int i;
+	for (i=0;i<MQ_LANES;i++) {
+		struct mq_segment *seg = new_segment();
+		ATOM_INIT(&q->lane[i].tail, (uintptr_t)seg);
+		q->lane[i].head = seg;
+		q->lane[i].head_slot = 0;
+	}
+	q->retired = NULL;
+	q->high_burst = 0;
+	q->overload = 0;
+	q->overload_threshold = MQ_OVERLOAD;
+	q->next = NULL;
+
+	return q;
+}
+
+static void
+free_segments(struct mq_segment *seg) {
+	while (seg) {
+		struct mq_segment *next = (struct mq_segment *)ATOM_LOAD(&seg->next);
+		skynet_free(seg);
+		seg = next;
+	}
+}
+
+static void
+_release(struct message_queue *q) {
+	assert(q->next == NULL);
+	int i;
+	for (i=0;i<MQ_LANES;i++) {
+		free_segments(q->lane[i].head);
+	}
+	struct mq_segment *seg = q->retired;
+	while (seg) {
+		struct mq_segment *retire = seg->retire;
+		skynet_free(seg);
+		seg = retire;
+	}
+	skynet_free((struct mq_segment *)ATOM_LOAD(&q->spare));
+	skynet_free(q);
+}
+
+// 消费者线程调用，tail 指向的 segment 只有在它前移之后才可能被回收
+static int
+lane_length(struct mq_lane *l) {
+	struct mq_segment *tail = (struct mq_segment *)ATOM_LOAD(&l->tail);
+	int alloc = ATOM_LOAD(&tail->alloc);
+	if (alloc > MQ_SEGMENT_SIZE) {
+		alloc = MQ_SEGMENT_SIZE;
+	}
+	int64_t length = (int64_t)(tail->base + alloc) - (int64_t)(l->head->base + l->head_slot);
+	// tail 可能暂时落后于 head
+	return length > 0 ? (int)length : 0;
+}
+
+int
+skynet_mq_lane_length(struct message_queue *q, int lane) {
+	assert(lane >= 0 && lane < MQ_LANES);
+	return lane_length(&q->lane[lane]);
+}
+
+int
+skynet_mq_length(struct message_queue *q) {
+	int length = 0;
+	int i;
+	for (i=0;i<MQ_LANES;i++) {
+		length += lane_length(&q->lane[i]);
+	}
+	return length;
+}
+
+// 返回通道队首已被生产者占用的槽位，没有则返回 NULL
+static struct mq_slot *
+head_slot(struct message_queue *q, struct mq_lane *l) {
+	struct mq_segment *seg = l->head;
+	if (l->head_slot == MQ_SEGMENT_SIZE) {
+		struct mq_segment *next = (struct mq_segment *)ATOM_LOAD(&seg->next);
+		if (next == NULL) {
+			return NULL;
+		}
+		seg->retire = q->retired;
+		q->retired = seg;
+		l->head = seg = next;
+		l->head_slot = 0;
+	}
+	if (ATOM_LOAD(&seg->alloc) > l->head_slot) {
+		return &seg->slot[l->head_slot];
+	}
+	return NULL;
+}
+
+// policy 和 shed 在 limit 之前写好，生产者读到 limit 之后才用它们
+void
+skynet_mq_limit(struct message_queue *q, int limit, int policy, uint32_t shed) {
+	ATOM_STORE(&q->limit, 0);
+	q->policy = policy;
+	q->shed = shed;
+	ATOM_STORE(&q->limit, limit);
+}
+
+int
+skynet_mq_dropped(struct message_queue *q) {
+	return ATOM_LOAD(&q->dropped);
+}
+
+// 生产者调用，这时 inflight 保证 tail segment 不会被回收；多个生产者同时检查时可能稍微超过上限
+static int
+producer_length(struct message_queue *q, struct mq_lane *l) {
+	struct mq_segment *tail = (struct mq_segment *)ATOM_LOAD(&l->tail);
+	int alloc = ATOM_LOAD(&tail->alloc);
+	if (alloc > MQ_SEGMENT_SIZE) {
+		alloc = MQ_SEGMENT_SIZE;
+	}
+	int length = (int)((uint32_t)(tail->base + alloc) - (uint32_t)ATOM_LOAD(&q->popped));
+	return length > 0 ? length : 0;
+}
+
+// 取出通道队首的消息，调用前 head_slot 已确认槽位被占用
+static void
+take_message(struct message_queue *q, struct mq_lane *l, struct skynet_message *message) {
+	struct mq_slot *slot = &l->head->slot[l->head_slot];
+	// 槽位已被占用，等生产者写完
+	while (!ATOM_LOAD(&slot->ready)) {}
+	*message = slot->msg;
+	ATOM_STORE(&slot->ready, 0);
+	++l->head_slot;
+	if (l == &q->lane[MQ_LANE_NORMAL]) {
+		ATOM_STORE(&q->popped, (int)(uint32_t)(l->head->base + l->head_slot));
+	}
+}
+
+// 生产者不能动队首，MQ_POLICY_DROPOLD 由消费者在 pop 时把超出上限的老消息挤掉
+static void
+evict_messages(struct message_queue *q, int limit) {
+	struct mq_lane *l = &q->lane[MQ_LANE_NORMAL];
+	while (lane_length(l) > limit && head_slot(q, l)) {
+		struct skynet_message drop;
+		take_message(q, l, &drop);
+		ATOM_FINC(&q->dropped);
+		overflow(q, &drop);
+	}
+}
+
+// 同 spinlock 版本，高优先级通道优先，但不让普通通道饿死
+static struct mq_lane *
+select_lane(struct message_queue *q) {
+	struct mq_lane *high = &q->lane[MQ_LANE_HIGH];
+	struct mq_lane *normal = &q->lane[MQ_LANE_NORMAL];
+	if (head_slot(q, high)) {
+		if (q->high_burst < MQ_HIGH_BURST) {
+			++q->high_burst;
+			return high;
+		}
+		if (head_slot(q, normal) == NULL) {
+			return high;
+		}
+	}
+	q->high_burst = 0;
+	return head_slot(q, normal) ? normal : NULL;
+}
+
+static void
+reclaim_segments(struct message_queue *q) {
+	if (ATOM_LOAD(&q->inflight) != 0) {
+		return;
+	}
+	// no producer holds a pointer to the retired segments now
+	struct mq_segment *seg = q->retired;
+	q->retired = NULL;
+	while (seg) {
+		struct mq_segment *retire = seg->retire;
+		recycle_segment(q, seg);
+		seg = retire;
+	}
+}
+
+int
+skynet_mq_pop(struct message_queue *q, struct skynet_message *message) {
+	int limit = ATOM_LOAD(&q->limit);
+	if (limit > 0 && q->policy == MQ_POLICY_DROPOLD) {
+		evict_messages(q, limit);
+	}
+	struct mq_lane *l = select_lane(q);
+	if (l == NULL) {
+		// reset overload_threshold when queue is empty
+		q->overload_threshold = MQ_OVERLOAD;
+		ATOM_STORE(&q->in_global, 0);
+		// 生产者可能在上面检查之后写入，却看到 in_global 仍为 1 而没有放回全局队列，再检查一次
+		l = select_lane(q);
+		if (l == NULL) {
+			return 1;
+		}
+		for (;;) {
+			int exp = 0;
+			if (ATOM_LOAD(&q->in_global) != 0) {
+				// the producer has pushed q into global mq
+				return 1;
+			}
+			if (ATOM_CAS(&q->in_global, exp, MQ_IN_GLOBAL)) {
+				break;
+			}
+		}
+	}
+
+	take_message(q, l, message);
+
+	if (q->retired) {
+		reclaim_segments(q);
+	}
+
+	int length = skynet_mq_length(q);
+	while (length > q->overload_threshold) {
+		q->overload = length;
+		q->overload_threshold *= 2;
+	}
+
+	return 0;
+}
+
+int
+skynet_mq_push_pending(struct message_queue *q, struct skynet_message *message) {
+	assert(message);
+	message->stamp = skynet_hpc();
+	int lane = lane_of(message);
+	struct mq_lane *l = &q->lane[lane];
+	ATOM_FINC(&q->inflight);
+	int limit = ATOM_LOAD(&q->limit);
+	if (lane == MQ_LANE_NORMAL && limit > 0) {
+		int action = limit_action(limit, q->policy, q->shed, producer_length(q, l), message);
+		if (action == MQ_REJECT) {
+			ATOM_FDEC(&q->inflight);
+			ATOM_FINC(&q->dropped);
+			overflow(q, message);
+			return 0;
+		}
+		// MQ_EVICT : push it anyway, see evict_messages
+	}
+	struct mq_segment *seg = (struct mq_segment *)ATOM_LOAD(&l->tail);
+	for (;;) {
+		int i = ATOM_FINC(&seg->alloc);
+		if (i < MQ_SEGMENT_SIZE) {
+			struct mq_slot *slot = &seg->slot[i];
+			slot->msg = *message;
+			ATOM_STORE(&slot->ready, 1);
+			break;
+		}
+		// segment 满了，链上下一个（别的生产者可能已经链上）
+		struct mq_segment *next = (struct mq_segment *)ATOM_LOAD(&seg->next);
+		if (next == NULL) {
+			struct mq_segment *ns = take_segment(q);
+			ns->base = seg->base + MQ_SEGMENT_SIZE;
+			uintptr_t exp = (uintptr_t)NULL;
+			if (ATOM_CAS_POINTER(&seg->next, exp, (uintptr_t)ns)) {
+				next = ns;
+			} else {
+				next = (struct mq_segment *)ATOM_LOAD(&seg->next);
+				recycle_segment(q, ns);
+			}
+		}
+		// tail must move forward before we leave, the consumer may reclaim seg once inflight is 0
+		while (ATOM_LOAD(&l->tail) == (uintptr_t)seg) {
+			uintptr_t exp = (uintptr_t)seg;
+			if (ATOM_CAS_POINTER(&l->tail, exp, (uintptr_t)next)) {
+				break;
+			}
+		}
+		seg = next;
+	}
+	ATOM_FDEC(&q->inflight);
+
+	while (ATOM_LOAD(&q->in_global) == 0) {
+		int exp = 0;
+		if (ATOM_CAS(&q->in_global, exp, MQ_IN_GLOBAL)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// every push is lock free already
+int
+skynet_mq_push_pending_n(struct message_queue *q, struct skynet_message message[], int n) {
+	int runnable = 0;
+	int i;
+	for (i=0;i<n;i++) {
+		runnable |= skynet_mq_push_pending(q, &message[i]);
+	}
+	return runnable;
+}
+
+void
+skynet_mq_mark_release(struct message_queue *q) {
+	assert(ATOM_LOAD(&q->release) == 0);
+	ATOM_STORE(&q->release, 1);
+	while (ATOM_LOAD(&q->in_global) == 0) {
+		int exp = 0;
+		if (ATOM_CAS(&q->in_global, exp, MQ_IN_GLOBAL)) {
+			skynet_globalmq_push(q);
+			break;
+		}
+	}
+}
+
+#endif
+
+void
+skynet_mq_push(struct message_queue *q, struct skynet_message *message) {
+	// in_global is set, no one else can push q into global mq, so it's safe out of the lock (and wakeup may block)
+	if (skynet_mq_push_pending(q, message)) {
+		skynet_globalmq_push(q);
+	}
 }
 
 static void
@@ -265,13 +1161,22 @@ _drop_queue(struct message_queue *q, message_drop drop_func, void *ud) {
 //释放q这条队列
 void 
 skynet_mq_release(struct message_queue *q, message_drop drop_func, void *ud) {
+#ifdef USE_LOCKFREE_MQ
+	if (ATOM_LOAD(&q->release)) {
+		_drop_queue(q, drop_func, ud);
+	} else {
+		skynet_globalmq_push(q);
+	}
+#else
 	SPIN_LOCK(q)
 	
 	if (q->release) { //已经skynet_mq_mark_release过，表示对应上下文已经删除
 		SPIN_UNLOCK(q)
 		_drop_queue(q, drop_func, ud); //删除消息队列
 	} else {
-		skynet_globalmq_push(q); //传入全局消息队列去执行，以置空消息队列，上下文引用为0即可skynet_mq_mark_release
 		SPIN_UNLOCK(q)
+		skynet_globalmq_push(q); //传入全局消息队列去执行，以置空消息队列，上下文引用为0即可skynet_mq_mark_release
 	}
+#endif
 }
+
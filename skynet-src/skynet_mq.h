@@ -9,17 +9,33 @@ struct skynet_message {
 	int session;
 	void * data;
 	size_t sz;
+	uint64_t stamp;	// skynet_hpc() when it's pushed, set by skynet_mq
 };
 
 // type is encoding in struct skynet_message.sz high 8bit
-#define MESSAGE_TYPE_MASK (SIZE_MAX >> 8)
+// the next bit marks a payload shared by skynet_send_batch (a reference count at the tail)
+#define MESSAGE_TYPE_MASK (SIZE_MAX >> 9)
 #define MESSAGE_TYPE_SHIFT ((sizeof(size_t)-1) * 8)
+#define MESSAGE_SHARED ((size_t)1 << (MESSAGE_TYPE_SHIFT - 1))
 
 struct message_queue;
 
 void skynet_globalmq_push(struct message_queue * queue);
 struct message_queue * skynet_globalmq_pop(void);
 
+// work steal mode : each worker thread owns a local run queue, call before worker threads start
+// node is the numa node of each worker (may be NULL), idle workers steal from the same node first
+void skynet_globalmq_worksteal(int worker, const int node[]);
+
+// bind the calling worker thread to its local run queue
+void skynet_globalmq_bindworker(int id);
+// number of runnable service queues (global and local), not exact
+int skynet_globalmq_length(void);
+// called after a queue becomes runnable, to wake up a parked worker
+void skynet_globalmq_wakeup(void (*wakeup)(void *ud), void *ud);
+// schedule the queues returned by skynet_mq_push_pending in one splice
+void skynet_globalmq_pushbatch(struct message_queue *queue[], int n);
+
 struct message_queue * skynet_mq_create(uint32_t handle);
 void skynet_mq_mark_release(struct message_queue *q);
 
@@ -31,9 +47,32 @@ uint32_t skynet_mq_handle(struct message_queue *);
 // 0 for success
 int skynet_mq_pop(struct message_queue *q, struct skynet_message *message);
 void skynet_mq_push(struct message_queue *q, struct skynet_message *message);
+// push without scheduling, return 1 if q becomes runnable and should be passed to skynet_globalmq_pushbatch
+int skynet_mq_push_pending(struct message_queue *q, struct skynet_message *message);
+// push n messages in one lock (messages under the mailbox limit are pushed one by one), return like skynet_mq_push_pending
+int skynet_mq_push_pending_n(struct message_queue *q, struct skynet_message message[], int n);
 
 // return the length of message queue, for debug
 int skynet_mq_length(struct message_queue *q);
+
+// responses, system and error messages go to the high lane, which is popped first
+#define MQ_LANE_HIGH 0
+#define MQ_LANE_NORMAL 1
+#define MQ_LANES 2
+
+int skynet_mq_lane_length(struct message_queue *q, int lane);
+
+// what to do when the normal lane of a mailbox reaches its limit
+#define MQ_POLICY_REJECT 0	// refuse the new message
+#define MQ_POLICY_DROPOLD 1	// evict the oldest message
+#define MQ_POLICY_SHED 2	// refuse the new message if its type is in the shed mask, never bound the other types
+
+// limit == 0 means unbounded (default), shed is a bitmask of (1 << type)
+void skynet_mq_limit(struct message_queue *q, int limit, int policy, uint32_t shed);
+// number of messages refused or evicted
+int skynet_mq_dropped(struct message_queue *q);
+// called (out of any lock) with every message refused or evicted, the hook owns the message
+void skynet_mq_overflow(void (*overflow)(uint32_t handle, struct skynet_message *msg));
 int skynet_mq_overload(struct message_queue *q);
 
 void skynet_mq_init();
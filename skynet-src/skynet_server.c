@@ -10,6 +10,9 @@
 #include "skynet_monitor.h"
 #include "skynet_imp.h"
 #include "skynet_log.h"
+#include "skynet_affinity.h"
+#include "skynet_stat.h"
+#include "skynet_socket.h"
 #include "skynet_timer.h"
 #include "spinlock.h"
 #include "atomic.h"
@@ -54,9 +57,14 @@ struct skynet_context {
 	int session_id;
 	ATOM_INT ref;
 	int message_count;
+	uint32_t dispatch_cost;	// in nanosec, moving average of one message, for timeslice
 	bool init;
 	bool endless;
 	bool profile;
+	bool borrow;	// cb never keeps the message, can read the payload of skynet_send_batch in place
+	struct timer_set * timers;	// pending timers for CANCEL
+	struct skynet_stat stat;	// queue wait and callback time histograms
+	struct skynet_context * free_next;	// in CONTEXT_POOL after deleted
 
 	CHECKCALLING_DECL
 };
@@ -67,10 +75,48 @@ struct skynet_node {
 	uint32_t monitor_exit;
 	pthread_key_t handle_key;
 	bool profile;	// default is off
+	int timeslice;	// in microsec, 0 means use the weight of worker
+	int thread;
 };
 
 static struct skynet_node G_NODE;
 
+// ĵڴ治ϵͳֻµĸãskynet_handle_grab ܻŸɾָ룬
+//  ref Ϊ 0  handle жϣڴһֱǸ
+struct context_pool {
+	struct spinlock lock;
+	struct skynet_context * head;
+};
+
+static struct context_pool CONTEXT_POOL;
+
+static struct skynet_context *
+context_alloc() {
+	struct context_pool *p = &CONTEXT_POOL;
+	SPIN_LOCK(p)
+	struct skynet_context * ctx = p->head;
+	if (ctx) {
+		p->head = ctx->free_next;
+	}
+	SPIN_UNLOCK(p)
+	if (ctx == NULL) {
+		ctx = skynet_malloc(sizeof(*ctx));
+		ATOM_INIT(&ctx->ref, 0);
+		ctx->timers = skynet_timer_newset();
+		skynet_stat_init(&ctx->stat);
+	}
+	return ctx;
+}
+
+static void
+context_free(struct skynet_context *ctx) {
+	struct context_pool *p = &CONTEXT_POOL;
+	SPIN_LOCK(p)
+	ctx->free_next = p->head;
+	p->head = ctx;
+	SPIN_UNLOCK(p)
+}
+
 int 
 skynet_context_total() {
 	return ATOM_LOAD(&G_NODE.total);
@@ -108,6 +154,31 @@ id_to_hex(char * str, uint32_t id) {
 	str[9] = '\0';
 }
 
+/*
+skynet_send_batch ͬһϢ壬ݺ()һüϢ sz  MESSAGE_SHARED ǡ
+ָǷ׵ַһ߿ͨϢһӹ(ͷŻ߱)
+*/
+static inline size_t
+shared_offset(size_t sz) {
+	// keep the '\0' after data as _filter_args does
+	return (sz + 1 + sizeof(ATOM_INT) - 1) & ~(sizeof(ATOM_INT) - 1);
+}
+
+static inline ATOM_INT *
+shared_ref(void *data, size_t sz) {
+	return (ATOM_INT *)((char *)data + shared_offset(sz));
+}
+
+static void
+free_message(struct skynet_message *msg) {
+	if (msg->sz & MESSAGE_SHARED) {
+		ATOM_INT *ref = shared_ref(msg->data, msg->sz & MESSAGE_TYPE_MASK);
+		if (ATOM_FDEC(ref) != 1)
+			return;
+	}
+	skynet_free(msg->data);
+}
+
 struct drop_t {
 	uint32_t handle;
 };
@@ -115,7 +186,7 @@ struct drop_t {
 static void
 drop_message(struct skynet_message *msg, void *ud) {
 	struct drop_t *d = ud;
-	skynet_free(msg->data);
+	free_message(msg);
 	uint32_t source = d->handle;
 	assert(source);
 	// report error to the message source
@@ -123,6 +194,23 @@ drop_message(struct skynet_message *msg, void *ud) {
 	skynet_send(NULL, source, msg->source, PTYPE_ERROR, 0, NULL, 0);
 }
 
+// ˱ܾ򼷵Ϣ session  PTYPE_ERROR ߷ͷ call һֱȣ
+// session Ϊ 0 Ĳ֪ͨΪ session 0  PTYPE_ERROR ʾѾ˳
+static void
+mailbox_overflow(uint32_t handle, struct skynet_message *msg) {
+	int type = msg->sz >> MESSAGE_TYPE_SHIFT;
+	if (type == PTYPE_SOCKET && msg->data) {
+		struct skynet_socket_message *sm = msg->data;
+		if (sm->type == SKYNET_SOCKET_TYPE_DATA || sm->type == SKYNET_SOCKET_TYPE_UDP) {
+			skynet_free(sm->buffer);
+		}
+	}
+	free_message(msg);
+	if (msg->session != 0 && msg->source != 0) {
+		skynet_send(NULL, handle, msg->source, PTYPE_ERROR, msg->session, NULL, 0);
+	}
+}
+
 // name 
 // param ʵ
 struct skynet_context * 
@@ -135,12 +223,12 @@ skynet_context_new(const char * name, const char *param) {
 	void *inst = skynet_module_instance_create(mod); // createӿڴʵ
 	if (inst == NULL)
 		return NULL;
-	struct skynet_context * ctx = skynet_malloc(sizeof(*ctx)); // ķ
+	struct skynet_context * ctx = context_alloc(); // ķ
 	CHECKCALLING_INIT(ctx) //ʼ
 
 	ctx->mod = mod; // ÷moduleָ룬createinitsignalreleaseе
 	ctx->instance = inst; // ָmodulecreateʵָ룬ͬһжʵÿӦԼ
-	ATOM_INIT(&ctx->ref , 2); // üΪ0ʱʾڴԱͷ
+	ATOM_STORE(&ctx->ref , 2); // üΪ0ʱʾڴԱͷ
 	ctx->cb = NULL; // Ϣصһskynet_moduleinitָ
 	ctx->cb_ud = NULL; // callbackʱشcallbackuserdataһʵָ
 	ctx->session_id = 0; // ڷյԷķϢʱͨsession_idƥһأӦĸ
@@ -152,7 +240,9 @@ skynet_context_new(const char * name, const char *param) {
 	ctx->cpu_cost = 0; // cpuʱ
 	ctx->cpu_start = 0; // ʼеʱ
 	ctx->message_count = 0; // Ϣܴ
+	ctx->dispatch_cost = 0; // timeslice ģʽÿϢƽʱ
 	ctx->profile = G_NODE.profile; // ȫеCPUͳƿ
+	ctx->borrow = false;
 	// Should set to 0 first to avoid skynet_handle_retireall get an uninitialized handle
 	ctx->handle = 0; // ʶΨһcontextķid
 	ctx->handle = skynet_handle_register(ctx); // <16config.harbor>00000000 + index
@@ -200,6 +290,19 @@ skynet_context_grab(struct skynet_context *ctx) {
 	ATOM_FINC(&ctx->ref);
 }
 
+// grab ctx unless it is being deleted (ref is 0), ctx may be a stale pointer of CONTEXT_POOL
+int
+skynet_context_trygrab(struct skynet_context *ctx) {
+	int ref = ATOM_LOAD(&ctx->ref);
+	while (ref > 0) {
+		if (ATOM_CAS(&ctx->ref, ref, ref + 1)) {
+			return 1;
+		}
+		ref = ATOM_LOAD(&ctx->ref);
+	}
+	return 0;
+}
+
 void
 skynet_context_reserve(struct skynet_context *ctx) {
 	skynet_context_grab(ctx);
@@ -216,8 +319,10 @@ delete_context(struct skynet_context *ctx) {
 	}
 	skynet_module_instance_release(ctx->mod, ctx->instance);
 	skynet_mq_mark_release(ctx->queue); // q->release = 1;׼ɾ
+	skynet_timer_resetset(ctx->timers);
+	skynet_stat_reset(&ctx->stat);
 	CHECKCALLING_DESTROY(ctx)
-	skynet_free(ctx);
+	context_free(ctx);
 	context_dec();
 }
 
@@ -242,6 +347,21 @@ skynet_context_push(uint32_t handle, struct skynet_message *message) {
 	return 0;
 }
 
+// n messages to one handle : one grab and one locked push
+int
+skynet_context_push_n(uint32_t handle, struct skynet_message *message, int n) {
+	struct skynet_context * ctx = skynet_handle_grab(handle);
+	if (ctx == NULL) {
+		return -1;
+	}
+	if (skynet_mq_push_pending_n(ctx->queue, message, n)) {
+		skynet_globalmq_push(ctx->queue);
+	}
+	skynet_context_release(ctx);
+
+	return 0;
+}
+
 void 
 skynet_context_endless(uint32_t handle) {
 	struct skynet_context * ctx = skynet_handle_grab(handle);
@@ -252,6 +372,17 @@ skynet_context_endless(uint32_t handle) {
 	skynet_context_release(ctx);
 }
 
+void
+skynet_context_signal(uint32_t handle, int sig) {
+	struct skynet_context * ctx = skynet_handle_grab(handle);
+	if (ctx == NULL) {
+		return;
+	}
+	// NOTICE: the signal function should be thread safe.
+	skynet_module_instance_signal(ctx->mod, ctx->instance, sig);
+	skynet_context_release(ctx);
+}
+
 int 
 skynet_isremote(struct skynet_context * ctx, uint32_t handle, int * harbor) {
 	int ret = skynet_harbor_message_isremote(handle);
@@ -268,22 +399,44 @@ dispatch_message(struct skynet_context *ctx, struct skynet_message *msg) {
 	pthread_setspecific(G_NODE.handle_key, (void *)(uintptr_t)(ctx->handle)); //ϢG_NODE.handle_keyΪctx->handlehookΪǰרڴ
 	int type = msg->sz >> MESSAGE_TYPE_SHIFT;
 	size_t sz = msg->sz & MESSAGE_TYPE_MASK;
+	void * data = msg->data;
+	ATOM_INT * shared = NULL;
+	if (msg->sz & MESSAGE_SHARED) {
+		ATOM_INT * ref = shared_ref(data, sz);
+		if (ATOM_LOAD(ref) == 1) {
+			// the last reference, take it over as a normal message
+		} else if (ctx->borrow) {
+			shared = ref;
+		} else {
+			// cb may keep the message, give it a private copy
+			data = skynet_malloc(sz + 1);
+			memcpy(data, msg->data, sz + 1);
+			free_message(msg);
+		}
+	}
 	FILE *f = (FILE *)ATOM_LOAD(&ctx->logfile);
 	if (f) {
-		skynet_log_output(f, msg->source, type, msg->session, msg->data, sz);
+		skynet_log_output(f, msg->source, type, msg->session, data, sz);
 	}
 	++ctx->message_count;
 	int reserve_msg;
+	uint64_t start = skynet_hpc();
 	if (ctx->profile) {
 		ctx->cpu_start = skynet_thread_time();
-		reserve_msg = ctx->cb(ctx, ctx->cb_ud, type, msg->session, msg->source, msg->data, sz);
+		reserve_msg = ctx->cb(ctx, ctx->cb_ud, type, msg->session, msg->source, data, sz);
 		uint64_t cost_time = skynet_thread_time() - ctx->cpu_start;
 		ctx->cpu_cost += cost_time;
 	} else {
-		reserve_msg = ctx->cb(ctx, ctx->cb_ud, type, msg->session, msg->source, msg->data, sz);
+		reserve_msg = ctx->cb(ctx, ctx->cb_ud, type, msg->session, msg->source, data, sz);
 	}
-	if (!reserve_msg) { //forwardģʽskynet_free,forwardģʽskynet.forward_type->lcallback
-		skynet_free(msg->data);
+	skynet_stat_record(&ctx->stat, type, start - msg->stamp, skynet_hpc() - start);
+	if (shared) {
+		assert(!reserve_msg);
+		if (ATOM_FDEC(shared) == 1) {
+			skynet_free(data);
+		}
+	} else if (!reserve_msg) { //forwardģʽskynet_free,forwardģʽskynet.forward_type->lcallback
+		skynet_free(data);
 	}
 	CHECKCALLING_END(ctx)
 }
@@ -298,6 +451,54 @@ skynet_context_dispatchall(struct skynet_context * ctx) {
 	}
 }
 
+// timeslice ģʽ£ƽÿϢĺʱദ
+// еķȹ̶߳ʱʱƬʱʱƬ
+static int
+dispatch_budget(struct skynet_context *ctx, int length, uint64_t now) {
+	uint64_t cost = ctx->dispatch_cost;
+	if (cost == 0) {
+		// no sample yet
+		return 1;
+	}
+	uint64_t slice = (uint64_t)G_NODE.timeslice * 1000;
+	// worksteal ģʽ skynet_globalmq_length Ҫɨһй̵߳ĶУÿ߳ÿֻȡһ
+	static __thread uint64_t runnable_tick = 0;
+	static __thread int runnable = 0;
+	uint64_t tick = now / 1000000;
+	if (tick != runnable_tick) {
+		runnable_tick = tick;
+		runnable = skynet_globalmq_length();
+	}
+	if (runnable > G_NODE.thread) {
+		slice = slice * G_NODE.thread / runnable;
+	}
+	uint64_t n = slice / cost;
+	if (n < 1) {
+		return 1;
+	}
+	if (n > length) {
+		return length;
+	}
+	return (int)n;
+}
+
+static void
+update_cost(struct skynet_context *ctx, uint64_t start, int n) {
+	if (n <= 0)
+		return;
+	uint64_t cost = (skynet_hpc() - start) / n;
+	if (cost == 0) {
+		cost = 1;
+	} else if (cost > UINT32_MAX) {
+		cost = UINT32_MAX;
+	}
+	if (ctx->dispatch_cost == 0) {
+		ctx->dispatch_cost = (uint32_t)cost;
+	} else {
+		ctx->dispatch_cost = (uint32_t)(((uint64_t)ctx->dispatch_cost * 7 + cost) / 8);
+	}
+}
+
 //sm ; q Ϣ; weight ߳Ȩ
 struct message_queue * 
 skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue *q, int weight) {
@@ -318,11 +519,18 @@ skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue
 
 	int i,n=1;
 	struct skynet_message msg;
+	uint64_t start = 0;
 
 	for (i=0;i<n;i++) {
 		if (skynet_mq_pop(q,&msg)) {
+			if (start) {
+				update_cost(ctx, start, i);
+			}
 			skynet_context_release(ctx); // ִϢͣӦskynet_context-1
 			return skynet_globalmq_pop();
+		} else if (i==0 && G_NODE.timeslice) {
+			start = skynet_hpc();
+			n = dispatch_budget(ctx, skynet_mq_length(q) + 1, start);
 		} else if (i==0 && weight >= 0) { // weight==0 У>0 λweight
 			n = skynet_mq_length(q);
 			n >>= weight;
@@ -335,7 +543,7 @@ skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue
 		skynet_monitor_trigger(sm, msg.source , handle); //
 
 		if (ctx->cb == NULL) {
-			skynet_free(msg.data);
+			free_message(&msg);
 		} else {
 			dispatch_message(ctx, &msg);
 		}
@@ -343,6 +551,10 @@ skynet_context_message_dispatch(struct skynet_monitor *sm, struct message_queue
 		skynet_monitor_trigger(sm, 0,0); //
 	}
 
+	if (start) {
+		update_cost(ctx, start, n);
+	}
+
 	assert(q == ctx->queue);
 	struct message_queue *nq = skynet_globalmq_pop();
 	if (nq) { //һλ
@@ -405,11 +617,32 @@ cmd_timeout(struct skynet_context * context, const char * param) {
 	char * session_ptr = NULL;
 	int ti = strtol(param, &session_ptr, 10); //string to int 10 طǷַ
 	int session = skynet_context_newsession(context);
-	skynet_timeout(context->handle, ti, session); //Ϣ
+	skynet_timeout(context->timers, context->handle, ti, session); //Ϣ
+	sprintf(context->result, "%d", session);
+	return context->result;
+}
+
+// TIMEOUTMS ms : same as TIMEOUT, in millisecond
+static const char *
+cmd_timeoutms(struct skynet_context * context, const char * param) {
+	int ti = strtol(param, NULL, 10);
+	int session = skynet_context_newsession(context);
+	skynet_timeout_ms(context->timers, context->handle, ti, session);
 	sprintf(context->result, "%d", session);
 	return context->result;
 }
 
+// CANCEL session : remove the timer before it expires, return NULL if it's already fired (or not exist)
+static const char *
+cmd_cancel(struct skynet_context * context, const char * param) {
+	int session = strtol(param, NULL, 10);
+	if (skynet_timer_cancel(context->timers, session)) {
+		strcpy(context->result, "1");
+		return context->result;
+	}
+	return NULL;
+}
+
 static const char *
 cmd_reg(struct skynet_context * context, const char * param) {
 	if (param == NULL || param[0] == '\0') {
@@ -561,6 +794,15 @@ cmd_stat(struct skynet_context * context, const char * param) {
 	if (strcmp(param, "mqlen") == 0) {
 		int len = skynet_mq_length(context->queue);
 		sprintf(context->result, "%d", len);
+	} else if (strcmp(param, "mqlen_high") == 0) {
+		int len = skynet_mq_lane_length(context->queue, MQ_LANE_HIGH);
+		sprintf(context->result, "%d", len);
+	} else if (strcmp(param, "mqlen_normal") == 0) {
+		int len = skynet_mq_lane_length(context->queue, MQ_LANE_NORMAL);
+		sprintf(context->result, "%d", len);
+	} else if (strcmp(param, "mqdrop") == 0) {
+		int n = skynet_mq_dropped(context->queue);
+		sprintf(context->result, "%d", n);
 	} else if (strcmp(param, "endless") == 0) {
 		if (context->endless) {
 			strcpy(context->result, "1");
@@ -581,6 +823,12 @@ cmd_stat(struct skynet_context * context, const char * param) {
 		}
 	} else if (strcmp(param, "message") == 0) {
 		sprintf(context->result, "%d", context->message_count);
+	} else if (strcmp(param, "latency") == 0) {
+		// histograms of every message type, see skynet_stat_dump
+		return skynet_stat_dump(&context->stat);
+	} else if (strcmp(param, "affinity") == 0) {
+		// the mapping of thread to cpu is too long for context->result
+		return skynet_affinity_info();
 	} else {
 		context->result[0] = '\0';
 	}
@@ -636,23 +884,66 @@ cmd_signal(struct skynet_context * context, const char * param) {
 	uint32_t handle = tohandle(context, param);
 	if (handle == 0)
 		return NULL;
-	struct skynet_context * ctx = skynet_handle_grab(handle);
-	if (ctx == NULL)
-		return NULL;
 	param = strchr(param, ' ');
 	int sig = 0;
 	if (param) {
 		sig = strtol(param, NULL, 0);
 	}
-	// NOTICE: the signal function should be thread safe.
-	skynet_module_instance_signal(ctx->mod, ctx->instance, sig);
+	skynet_context_signal(handle, sig);
+	return NULL;
+}
 
+// MAILBOX address limit [reject|dropold|shed] [type ...]
+// Ʒͨͨĳȣlimit Ϊ 0 ȡơshed ֻгϢ
+static const char *
+cmd_mailbox(struct skynet_context * context, const char * param) {
+	size_t sz = strlen(param);
+	char tmp[sz+1];
+	strcpy(tmp,param);
+	char * args = tmp;
+	char * addr = strsep(&args, " ");
+	char * limit = strsep(&args, " ");
+	if (limit == NULL) {
+		skynet_error(context, "Invalid MAILBOX %s", param);
+		return NULL;
+	}
+	uint32_t handle = tohandle(context, addr);
+	if (handle == 0)
+		return NULL;
+	int policy = MQ_POLICY_REJECT;
+	char * name = strsep(&args, " ");
+	if (name == NULL || strcmp(name, "reject") == 0) {
+		policy = MQ_POLICY_REJECT;
+	} else if (strcmp(name, "dropold") == 0) {
+		policy = MQ_POLICY_DROPOLD;
+	} else if (strcmp(name, "shed") == 0) {
+		policy = MQ_POLICY_SHED;
+	} else {
+		skynet_error(context, "Invalid MAILBOX policy %s", name);
+		return NULL;
+	}
+	uint32_t shed = 0;
+	char * type;
+	while ((type = strsep(&args, " ")) != NULL) {
+		if (type[0] == '\0')
+			continue;
+		int t = strtol(type, NULL, 10);
+		if (t >= 0 && t < 32) {
+			shed |= 1u << t;
+		}
+	}
+	struct skynet_context * ctx = skynet_handle_grab(handle);
+	if (ctx == NULL)
+		return NULL;
+	skynet_mq_limit(ctx->queue, strtol(limit, NULL, 10), policy, shed);
 	skynet_context_release(ctx);
 	return NULL;
 }
 
 static struct command_func cmd_funcs[] = {
 	{ "TIMEOUT", cmd_timeout },
+	{ "TIMEOUTMS", cmd_timeoutms },
+	{ "CANCEL", cmd_cancel },
 	{ "REG", cmd_reg },
 	{ "QUERY", cmd_query },
 	{ "NAME", cmd_name },
@@ -668,6 +959,7 @@ static struct command_func cmd_funcs[] = {
 	{ "LOGON", cmd_logon },
 	{ "LOGOFF", cmd_logoff },
 	{ "SIGNAL", cmd_signal },
+	{ "MAILBOX", cmd_mailbox },
 	{ NULL, NULL },
 };
 
@@ -791,6 +1083,88 @@ skynet_sendname(struct skynet_context * context, uint32_t source, const char * a
 	return skynet_send(context, source, des, type, session, data, sz);
 }
 
+// ÿһμȡģһΰѱɿеĶнӵȶ
+#define SEND_BATCH 256
+
+int
+skynet_send_batch(struct skynet_context * context, uint32_t source, const uint32_t handles[], int n, int type, int session, void * data, size_t sz) {
+	if ((sz & MESSAGE_TYPE_MASK) != sz) {
+		skynet_error(context, "The message to %d services is too large", n);
+		if (type & PTYPE_TAG_DONTCOPY) {
+			skynet_free(data);
+		}
+		return -2;
+	}
+	assert(!(type & PTYPE_TAG_ALLOCSESSION));
+	int needcopy = !(type & PTYPE_TAG_DONTCOPY);
+	type &= 0xff;
+	if (source == 0) {
+		source = context->handle;
+	}
+
+	ATOM_INT * ref = NULL;
+	size_t msgsz = sz | (size_t)type << MESSAGE_TYPE_SHIFT;
+	if (data) {
+		if (needcopy) {
+			char * msg = skynet_malloc(shared_offset(sz) + sizeof(ATOM_INT));
+			memcpy(msg, data, sz);
+			msg[sz] = '\0';
+			data = msg;
+		} else {
+			data = skynet_realloc(data, shared_offset(sz) + sizeof(ATOM_INT));
+		}
+		ref = shared_ref(data, sz);
+		// hold by the sender until all the messages are pushed
+		ATOM_INIT(ref, 1);
+		msgsz |= MESSAGE_SHARED;
+	}
+
+	struct skynet_context * ctx[SEND_BATCH];
+	struct message_queue * runnable[SEND_BATCH];
+	int delivered = 0;
+	int i,j;
+	for (i=0;i<n;i+=SEND_BATCH) {
+		int count = n - i < SEND_BATCH ? n - i : SEND_BATCH;
+		skynet_handle_grab_batch(handles + i, count, ctx);
+		int nrun = 0;
+		for (j=0;j<count;j++) {
+			if (ctx[j] == NULL) {
+				uint32_t des = handles[i+j];
+				if (skynet_harbor_message_isremote(des)) {
+					// remote service, send a copy by harbor
+					if (skynet_send(context, source, des, type, session, data, sz) >= 0) {
+						++delivered;
+					}
+				}
+				continue;
+			}
+			struct skynet_message smsg;
+			smsg.source = source;
+			smsg.session = session;
+			smsg.data = data;
+			smsg.sz = msgsz;
+			if (ref) {
+				ATOM_FINC(ref);
+			}
+			if (skynet_mq_push_pending(ctx[j]->queue, &smsg)) {
+				runnable[nrun++] = ctx[j]->queue;
+			}
+			++delivered;
+		}
+		skynet_globalmq_pushbatch(runnable, nrun);
+		for (j=0;j<count;j++) {
+			if (ctx[j]) {
+				skynet_context_release(ctx[j]);
+			}
+		}
+	}
+
+	if (ref && ATOM_FDEC(ref) == 1) {
+		skynet_free(data);
+	}
+	return delivered;
+}
+
 uint32_t 
 skynet_context_handle(struct skynet_context *ctx) {
 	return ctx->handle;
@@ -800,6 +1174,12 @@ void
 skynet_callback(struct skynet_context * context, void *ud, skynet_cb cb) {
 	context->cb = cb;
 	context->cb_ud = ud;
+	context->borrow = false;
+}
+
+void
+skynet_callback_borrow(struct skynet_context * context, int borrow) {
+	context->borrow = borrow;
 }
 
 void
@@ -818,6 +1198,9 @@ skynet_globalinit(void) {
 	ATOM_INIT(&G_NODE.total , 0);
 	G_NODE.monitor_exit = 0;
 	G_NODE.init = 1;
+	SPIN_INIT(&CONTEXT_POOL);
+	CONTEXT_POOL.head = NULL;
+	skynet_mq_overflow(mailbox_overflow);
 	if (pthread_key_create(&G_NODE.handle_key, NULL)) { //̵߳˽пռ pthread_key_t
 		fprintf(stderr, "pthread_key_create failed");
 		exit(1);
@@ -841,3 +1224,9 @@ void
 skynet_profile_enable(int enable) {
 	G_NODE.profile = (bool)enable;
 }
+
+void
+skynet_dispatch_timeslice(int timeslice, int thread) {
+	G_NODE.timeslice = timeslice > 0 ? timeslice : 0;
+	G_NODE.thread = thread;
+}
@@ -10,10 +10,13 @@ struct skynet_monitor;
 
 struct skynet_context * skynet_context_new(const char * name, const char * parm);
 void skynet_context_grab(struct skynet_context *);
+int skynet_context_trygrab(struct skynet_context *);	// 0 if the context is being deleted
+
 void skynet_context_reserve(struct skynet_context *ctx);
 struct skynet_context * skynet_context_release(struct skynet_context *);
 uint32_t skynet_context_handle(struct skynet_context *);
 int skynet_context_push(uint32_t handle, struct skynet_message *message);
+int skynet_context_push_n(uint32_t handle, struct skynet_message *message, int n);	// n messages, one grab and one locked push
 void skynet_context_send(struct skynet_context * context, void * msg, size_t sz, uint32_t source, int type, int session);
 int skynet_context_newsession(struct skynet_context *);
 struct message_queue * skynet_context_message_dispatch(struct skynet_monitor *, struct message_queue *, int weight);	// return next queue
@@ -21,11 +24,14 @@ int skynet_context_total();
 void skynet_context_dispatchall(struct skynet_context * context);	// for skynet_error output before exit
 
 void skynet_context_endless(uint32_t handle);	// for monitor
+void skynet_context_signal(uint32_t handle, int sig);	// signal 0 : break the lua service, 1 : memory, 2 : traceback
 
 void skynet_globalinit(void);
 void skynet_globalexit(void);
 void skynet_initthread(int m);
 
 void skynet_profile_enable(int enable);
+void skynet_dispatch_timeslice(int timeslice, int thread);	// in microsec, 0 for the weight table
+
 
 #endif
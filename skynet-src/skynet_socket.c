@@ -5,6 +5,7 @@
 #include "skynet_server.h"
 #include "skynet_mq.h"
 #include "skynet_harbor.h"
+#include "atomic.h"
 
 #include <stdio.h>
 #include <assert.h>
@@ -12,7 +13,25 @@
 #include <string.h>
 #include <stdbool.h>
 
-static struct socket_server * SOCKET_SERVER = NULL;
+#define MAX_SOCKET_THREAD 64
+
+// 每个 socket 线程一个 socket_server，socket id 的高位是它的序号
+static struct socket_server * SOCKET_SERVER[MAX_SOCKET_THREAD];
+static int SOCKET_THREAD = 0;
+static ATOM_INT SOCKET_NEXT;
+
+static inline struct socket_server *
+socket_owner(int id) {
+	return SOCKET_SERVER[socket_server_shard(id, SOCKET_THREAD)];
+}
+
+// a new socket goes to the socket threads in turn
+static inline struct socket_server *
+socket_next() {
+	if (SOCKET_THREAD == 1)
+		return SOCKET_SERVER[0];
+	return SOCKET_SERVER[(unsigned)ATOM_FINC(&SOCKET_NEXT) % SOCKET_THREAD];
+}
 
 /*
 从初始化代码来看，我们可以知道skynet的网络层使用了epoll模型，epoll属于同步io，当没有任何一个fd能收到客户端发送过来的数据包，
@@ -49,24 +68,52 @@ skynet接收客户端消息流程
  */
 
 void 
-skynet_socket_init() {
-	SOCKET_SERVER = socket_server_create(skynet_now());
+skynet_socket_init(int thread) {
+	if (thread < 1)
+		thread = 1;
+	if (thread > MAX_SOCKET_THREAD)
+		thread = MAX_SOCKET_THREAD;
+	int i;
+	for (i=0;i<thread;i++) {
+		SOCKET_SERVER[i] = socket_server_create(skynet_now());
+	}
+	SOCKET_THREAD = thread;
+	ATOM_INIT(&SOCKET_NEXT, 0);
+	if (thread > 1) {
+		socket_server_group(SOCKET_SERVER, thread);
+	}
+}
+
+int
+skynet_socket_thread() {
+	return SOCKET_THREAD;
 }
 
 void
 skynet_socket_exit() {
-	socket_server_exit(SOCKET_SERVER);
+	int i;
+	for (i=0;i<SOCKET_THREAD;i++) {
+		socket_server_exit(SOCKET_SERVER[i]);
+	}
 }
 
 void
 skynet_socket_free() {
-	socket_server_release(SOCKET_SERVER);
-	SOCKET_SERVER = NULL;
+	int i;
+	for (i=0;i<SOCKET_THREAD;i++) {
+		socket_server_release(SOCKET_SERVER[i]);
+		SOCKET_SERVER[i] = NULL;
+	}
+	SOCKET_THREAD = 0;
 }
 
 void
 skynet_socket_updatetime() {
-	socket_server_updatetime(SOCKET_SERVER, skynet_now());
+	uint64_t now = skynet_now();
+	int i;
+	for (i=0;i<SOCKET_THREAD;i++) {
+		socket_server_updatetime(SOCKET_SERVER[i], now);
+	}
 }
 
 // mainloop thread
@@ -110,10 +157,10 @@ forward_message(int type, bool padding, struct socket_message * result) {
 	}
 }
 
-//socket 线程工作
+//socket 线程工作，thread 是第几个 socket 线程
 int 
-skynet_socket_poll() {
-	struct socket_server *ss = SOCKET_SERVER;
+skynet_socket_poll(int thread) {
+	struct socket_server *ss = SOCKET_SERVER[thread];
 	assert(ss);
 	struct socket_message result;
 	int more = 1;
@@ -156,78 +203,78 @@ skynet_socket_poll() {
 //call by lua-socket.c:lsend 来源 worker 线程 lua 服务 send 语义
 int
 skynet_socket_sendbuffer(struct skynet_context *ctx, struct socket_sendbuffer *buffer) {
-	return socket_server_send(SOCKET_SERVER, buffer);
+	return socket_server_send(socket_owner(buffer->id), buffer);
 }
 
 //call by lua-socket.c:lsendlow 来源 worker 线程 lua 服务 send 语义
 int
 skynet_socket_sendbuffer_lowpriority(struct skynet_context *ctx, struct socket_sendbuffer *buffer) {
-	return socket_server_send_lowpriority(SOCKET_SERVER, buffer);
+	return socket_server_send_lowpriority(socket_owner(buffer->id), buffer);
 }
 
 // lua socket listen
 int 
 skynet_socket_listen(struct skynet_context *ctx, const char *host, int port, int backlog) {
 	uint32_t source = skynet_context_handle(ctx);
-	return socket_server_listen(SOCKET_SERVER, source, host, port, backlog);
+	return socket_server_listen(socket_next(), source, host, port, backlog);
 }
 
 int 
 skynet_socket_connect(struct skynet_context *ctx, const char *host, int port) {
 	uint32_t source = skynet_context_handle(ctx);
-	return socket_server_connect(SOCKET_SERVER, source, host, port);
+	return socket_server_connect(socket_next(), source, host, port);
 }
 
 int 
 skynet_socket_bind(struct skynet_context *ctx, int fd) {
 	uint32_t source = skynet_context_handle(ctx);
-	return socket_server_bind(SOCKET_SERVER, source, fd);
+	return socket_server_bind(socket_next(), source, fd);
 }
 
 void 
 skynet_socket_close(struct skynet_context *ctx, int id) {
 	uint32_t source = skynet_context_handle(ctx);
-	socket_server_close(SOCKET_SERVER, source, id);
+	socket_server_close(socket_owner(id), source, id);
 }
 
 void 
 skynet_socket_shutdown(struct skynet_context *ctx, int id) {
 	uint32_t source = skynet_context_handle(ctx);
-	socket_server_shutdown(SOCKET_SERVER, source, id);
+	socket_server_shutdown(socket_owner(id), source, id);
 }
 
 void 
 skynet_socket_start(struct skynet_context *ctx, int id) {
 	uint32_t source = skynet_context_handle(ctx);
-	socket_server_start(SOCKET_SERVER, source, id);
+	socket_server_start(socket_owner(id), source, id);
 }
 
 void
 skynet_socket_pause(struct skynet_context *ctx, int id) {
 	uint32_t source = skynet_context_handle(ctx);
-	socket_server_pause(SOCKET_SERVER, source, id);
+	socket_server_pause(socket_owner(id), source, id);
 }
 
 
 void
 skynet_socket_nodelay(struct skynet_context *ctx, int id) {
-	socket_server_nodelay(SOCKET_SERVER, id);
+	socket_server_nodelay(socket_owner(id), id);
 }
 
 int 
 skynet_socket_udp(struct skynet_context *ctx, const char * addr, int port) {
 	uint32_t source = skynet_context_handle(ctx);
-	return socket_server_udp(SOCKET_SERVER, source, addr, port);
+	return socket_server_udp(socket_next(), source, addr, port);
 }
 
 int 
 skynet_socket_udp_connect(struct skynet_context *ctx, int id, const char * addr, int port) {
-	return socket_server_udp_connect(SOCKET_SERVER, id, addr, port);
+	return socket_server_udp_connect(socket_owner(id), id, addr, port);
 }
 
 int 
 skynet_socket_udp_sendbuffer(struct skynet_context *ctx, const char * address, struct socket_sendbuffer *buffer) {
-	return socket_server_udp_send(SOCKET_SERVER, (const struct socket_udp_address *)address, buffer);
+	return socket_server_udp_send(socket_owner(buffer->id), (const struct socket_udp_address *)address, buffer);
 }
 
 const char *
@@ -240,10 +287,36 @@ skynet_socket_udp_address(struct skynet_socket_message *msg, int *addrsz) {
 	sm.opaque = 0;
 	sm.ud = msg->ud;
 	sm.data = msg->buffer;
-	return (const char *)socket_server_udp_address(SOCKET_SERVER, &sm, addrsz);
+	return (const char *)socket_server_udp_address(socket_owner(sm.id), &sm, addrsz);
+}
+
+void
+skynet_socket_recycle(void *buffer, int sz) {
+	socket_server_recycle(buffer, sz);
+}
+
+void
+skynet_socket_recvpool(struct socket_recvpool_stat *stat) {
+	int i;
+	memset(stat, 0, sizeof(*stat));
+	for (i=0;i<SOCKET_THREAD;i++) {
+		socket_server_recvpool(SOCKET_SERVER[i], stat);
+	}
 }
 
 struct socket_info *
 skynet_socket_info() {
-	return socket_server_info(SOCKET_SERVER);
+	struct socket_info *si = NULL;
+	int i;
+	for (i=SOCKET_THREAD-1;i>=0;i--) {
+		struct socket_info *list = socket_server_info(SOCKET_SERVER[i]);
+		if (list) {
+			struct socket_info *tail = list;
+			while (tail->next)
+				tail = tail->next;
+			tail->next = si;
+			si = list;
+		}
+	}
+	return si;
 }
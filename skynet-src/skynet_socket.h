@@ -21,10 +21,11 @@ struct skynet_socket_message {
 	char * buffer;
 };
 
-void skynet_socket_init();
+void skynet_socket_init(int thread);
+int skynet_socket_thread();
 void skynet_socket_exit();
 void skynet_socket_free();
-int skynet_socket_poll();
+int skynet_socket_poll(int thread);
 void skynet_socket_updatetime();
 
 int skynet_socket_sendbuffer(struct skynet_context *ctx, struct socket_sendbuffer *buffer);
@@ -45,6 +46,10 @@ const char * skynet_socket_udp_address(struct skynet_socket_message *, int *addr
 
 struct socket_info * skynet_socket_info();
 
+// give the buffer of SKYNET_SOCKET_TYPE_DATA (size sz) back to the receive buffer pool, instead of skynet_free
+void skynet_socket_recycle(void *buffer, int sz);
+void skynet_socket_recvpool(struct socket_recvpool_stat *stat);
+
 // legacy APIs
 
 static inline void sendbuffer_init_(struct socket_sendbuffer *buf, int id, const void *buffer, int sz) {
@@ -9,9 +9,14 @@
 #include "skynet_socket.h"
 #include "skynet_daemon.h"
 #include "skynet_harbor.h"
+#include "skynet_affinity.h"
+#include "atomic.h"
 
 #include <pthread.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,8 +27,7 @@
 有4种线程：
 monitor 监视线程：5秒检查一次是否有消息卡住
 
-timer 定时器线程：每2.5毫秒工作一次(由于 skynet 最小时间单位为10毫秒，不过这决定了无法用1毫秒，一般更小粒度只能设为5毫秒)，
-并试图唤醒一个睡眠的工作线程；
+timer 定时器线程：睡到时间轮下一个可能到期的刻度(最多 TIMER_MAX_SLEEP 毫秒)，刻度默认10毫秒，可以配成1毫秒 (timer_resolution)；
 处理 skynet.timeout, skynet.sleep 等函数时间轮添加节点，在32位数据中
 32位是分第1~8,9~14,15~20,21~26,27~32位的，5个级别，分别对应 t[3][0],t[0],t[1],t[2],t[3] ,相差0~2.55s以内存 near ,大于 2.55s 存单位刻度向量 t
 
@@ -32,7 +36,8 @@ socket 网络线程：epoll(linux) 处理网络消息，不停工作
 除非多服务 socket.write 可能并发，锁住走 epoll 管道排队发送；epoll 用默认模式，注册事件，不停通知，wait 后处理所有触发的事件
 epoll 是由一个红黑树事件节点表和一个双向链表事件触发通知表组成
 
-worker 工作线程：处理服务队列消息，不停工作，直到全局队列没有服务消息队列了(没消息了)，睡眠，等被 timer 线程唤醒
+worker 工作线程：处理服务队列消息，不停工作，直到全局队列没有服务消息队列了(没消息了)，睡眠，
+等有服务队列变为可运行时 (skynet_globalmq_push) 被唤醒一个
 由初始分配的线程的权重决定处理多少消息，< 4 时由于数量太少，为了保证没有服务被饿死，
 每次只处理一个服务消息队列中的一条消息，> 4 < 8 时处理全部消息，有线程保证不饿死了，我们就是来榨干 CPU 的，
 > 8 时处理的消息数递减，保证流畅？
@@ -44,10 +49,14 @@ struct monitor {
 	struct skynet_monitor ** m;
 	pthread_cond_t cond;
 	pthread_mutex_t mutex;
-	int sleep;
+	ATOM_INT sleep;
+	ATOM_INT waking; // 已经唤醒了一个工作线程，它还没跑起来
 	int quit;
 };
 
+// timer 线程最多睡这么久，用来检查退出和 SIGHUP
+#define TIMER_MAX_SLEEP 100
+
 struct worker_parm {
 	struct monitor *m;
 	int id;
@@ -73,27 +82,46 @@ create_thread(pthread_t *thread, void *(*start_routine) (void *), void *arg) {
 	}
 }
 
+// 有服务队列变为可运行时调用 (skynet_globalmq_push)，有睡眠的工作线程就唤醒一个
+// 同一时间只唤醒一个，被唤醒的线程跑起来以后才允许再唤醒下一个，避免一批消息把所有线程都叫醒。
+// 唤醒中丢掉的那些由被唤醒的线程接力：它醒来时还有别的队列可运行，就再唤醒下一个，见 thread_worker
 static void
-wakeup(struct monitor *m, int busy) {
-	if (m->sleep >= m->count - busy) { // 睡眠的工作线程数大于等于 1 吗，是即唤醒一个工作线程(仅一个)
+wakeup(void *ud) {
+	struct monitor *m = ud;
+	if (ATOM_LOAD(&m->sleep) == 0)
+		return;
+	for (;;) {
+		int exp = 0;
+		if (ATOM_LOAD(&m->waking))
+			return;
+		if (ATOM_CAS(&m->waking, exp, 1))
+			break;
+	}
+	// lock the mutex, or the signal may lost when the worker is going to wait
+	pthread_mutex_lock(&m->mutex);
+	if (ATOM_LOAD(&m->sleep) > 0) {
 		// signal sleep worker, "spurious wakeup" is harmless
 		pthread_cond_signal(&m->cond); //发送一个信号给另外一个正在处于阻塞等待状态的线程,使其脱离阻塞状态,继续执行( thread_worker pthread_cond_wait 处)
+	} else {
+		ATOM_STORE(&m->waking, 0);
 	}
+	pthread_mutex_unlock(&m->mutex);
 }
 
 static void *
 thread_socket(void *p) {
-	struct monitor * m = p;
+	int id = (int)(intptr_t)p; // 第几个 socket 线程
 	skynet_initthread(THREAD_SOCKET);
+
+	skynet_affinity_bind(THREAD_SOCKET, id);
 	for (;;) { //不停工作
-		int r = skynet_socket_poll();
+		int r = skynet_socket_poll(id);
 		if (r==0) //结束
 			break;
 		if (r<0) { //报错或更多没处理
 			CHECK_ABORT
 			continue;
 		}
-		wakeup(m,0); // check 是不是全睡着了，是则唤醒一个
 	}
 	return NULL;
 }
@@ -117,14 +145,17 @@ thread_monitor(void *p) {
 	int i;
 	int n = m->count;
 	skynet_initthread(THREAD_MONITOR);
+	skynet_affinity_bind(THREAD_MONITOR, 0);
+	int interval = skynet_monitor_interval();
 	for (;;) {
 		CHECK_ABORT
-		for (i=0;i<n;i++) { //遍历所有监视器(每隔5秒一次)
+		for (i=0;i<n;i++) { //遍历所有监视器(每隔 interval 毫秒一次)
 			skynet_monitor_check(m->m[i]);
 		}
-		for (i=0;i<5;i++) { //暂停5秒，每秒 check 结束
+		int t;
+		for (t=interval;t>0;t-=1000) { //最多睡 1 秒就 check 一下结束
 			CHECK_ABORT
-			sleep(1);
+			usleep((t > 1000 ? 1000 : t) * 1000);
 		}
 	}
 
@@ -151,12 +182,16 @@ static void *
 thread_timer(void *p) {
 	struct monitor * m = p;
 	skynet_initthread(THREAD_TIMER);
+	skynet_affinity_bind(THREAD_TIMER, 0);
+#ifdef __linux__
+	// wake up on the tick, the default 50us slack is too much for 1ms tick
+	prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+#endif
 	for (;;) {
 		skynet_updatetime();
 		skynet_socket_updatetime();
 		CHECK_ABORT
-		wakeup(m,m->count-1);
-		usleep(2500); //0.0025秒
+		skynet_timer_sleep(TIMER_MAX_SLEEP);
 		if (SIG) { //处理挂起信号
 			signal_hup();
 			SIG = 0;
@@ -181,22 +216,36 @@ thread_worker(void *p) {
 	struct monitor *m = wp->m;
 	struct skynet_monitor *sm = m->m[id];
 	skynet_initthread(THREAD_WORKER);
+	skynet_affinity_bind(THREAD_WORKER, id);
+	skynet_globalmq_bindworker(id);
 	struct message_queue * q = NULL;
 	while (!m->quit) {
 		q = skynet_context_message_dispatch(sm, q, weight);
 		if (q == NULL) {
+			int woken = 0;
 			if (pthread_mutex_lock(&m->mutex) == 0) {
-				++ m->sleep;
+				ATOM_FINC(&m->sleep);
+				// A queue may become runnable before we count in m->sleep, and nobody wakes us up.
+				// Check again after counted in, skynet_globalmq_push checks m->sleep after pushed.
+				q = skynet_globalmq_pop();
 				// "spurious wakeup" is harmless,
 				// because skynet_context_message_dispatch() can be call at any time.
-				if (!m->quit)
+				if (q == NULL && !m->quit) {
 					pthread_cond_wait(&m->cond, &m->mutex);
-				-- m->sleep;
+					ATOM_STORE(&m->waking, 0);
+					woken = 1;
+				}
+				ATOM_FDEC(&m->sleep);
 				if (pthread_mutex_unlock(&m->mutex)) {
 					fprintf(stderr, "unlock mutex error");
 					exit(1);
 				}
 			}
+			// a burst (timer group dispatch, skynet_globalmq_pushbatch ...) wakes only one worker,
+			// it takes one queue and passes the wakeup on if there are more
+			if (woken && skynet_globalmq_length() > 1) {
+				wakeup(m);
+			}
 		}
 	}
 	return NULL;
@@ -204,12 +253,14 @@ thread_worker(void *p) {
 
 static void
 start(int thread) {
-	pthread_t pid[thread+3];
+	int socket_thread = skynet_socket_thread();
+	pthread_t pid[thread+2+socket_thread];
 
 	struct monitor *m = skynet_malloc(sizeof(*m));
 	memset(m, 0, sizeof(*m));
 	m->count = thread;
-	m->sleep = 0;
+	ATOM_INIT(&m->sleep, 0);
+	ATOM_INIT(&m->waking, 0);
 
 	m->m = skynet_malloc(thread * sizeof(struct skynet_monitor *));
 	int i;
@@ -225,9 +276,13 @@ start(int thread) {
 		exit(1);
 	}
 
+	skynet_globalmq_wakeup(wakeup, m);
+
 	create_thread(&pid[0], thread_monitor, m);
 	create_thread(&pid[1], thread_timer, m);
-	create_thread(&pid[2], thread_socket, m);
+	for (i=0;i<socket_thread;i++) {
+		create_thread(&pid[2+i], thread_socket, (void *)(intptr_t)i);
+	}
 
 	//权重值决定一条线程一次消费多少条次级消息队列里的消息，
 	//当权重值< 0，worker线程一次消费一条消息（从次级消息队列中pop一个消息）；第1-4条线程
@@ -245,7 +300,9 @@ start(int thread) {
 		1, 1, 1, 1, 1, 1, 1, 1, 
 		2, 2, 2, 2, 2, 2, 2, 2, 
 		3, 3, 3, 3, 3, 3, 3, 3, };
+	// 配置了 timeslice 时，weight 不再使用，见 skynet_context_message_dispatch
 	struct worker_parm wp[thread];
+
 	for (i=0;i<thread;i++) {
 		wp[i].m = m;
 		wp[i].id = i;
@@ -254,13 +311,15 @@ start(int thread) {
 		} else {
 			wp[i].weight = 0;
 		}
-		create_thread(&pid[i+3], thread_worker, &wp[i]);
+		create_thread(&pid[i+2+socket_thread], thread_worker, &wp[i]);
 	}
 
-	for (i=0;i<thread+3;i++) {
+	for (i=0;i<thread+2+socket_thread;i++) {
 		pthread_join(pid[i], NULL); 
 	}
 
+	skynet_globalmq_wakeup(NULL, NULL);
+
 	free_monitor(m);
 }
 
@@ -295,10 +354,17 @@ skynet_start(struct skynet_config * config) {
 	skynet_harbor_init(config->harbor);
 	skynet_handle_init(config->harbor);
 	skynet_mq_init();
+	skynet_affinity_init(config);
+	if (config->worksteal) {
+		skynet_globalmq_worksteal(config->thread, skynet_affinity_node());
+	}
+
 	skynet_module_init(config->module_path);
-	skynet_timer_init();
-	skynet_socket_init();
+	skynet_timer_init(config->timer_resolution);
+	skynet_monitor_init(config->stall_threshold, config->monitor_interval);
+	skynet_socket_init(config->socket_thread);
 	skynet_profile_enable(config->profile);
+	skynet_dispatch_timeslice(config->timeslice, config->thread);
 
 	struct skynet_context *ctx = skynet_context_new(config->logservice, config->logger);
 	if (ctx == NULL) {
@@ -315,6 +381,8 @@ skynet_start(struct skynet_config * config) {
 	// harbor_exit may call socket send, so it should exit before socket_free
 	skynet_harbor_exit();
 	skynet_socket_free();
+	skynet_affinity_exit();
+
 	if (config->daemon) {
 		daemon_exit(config->daemon);
 	}
@@ -0,0 +1,97 @@
+#include "skynet.h"
+#include "skynet_stat.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+每个服务每种消息类型两张按 2 的幂分桶的直方图：消息在队列里等了多久 (入队时 skynet_mq 打的 skynet_hpc 时间戳)，
+回调执行了多久。只有派发这个服务的工作线程写，STAT latency 也是服务自己读，都不用加锁。
+直方图第一次用到某个类型时才分配，大部分服务只用到两三种类型。
+*/
+
+void
+skynet_stat_init(struct skynet_stat *s) {
+	memset(s, 0, sizeof(*s));
+}
+
+void
+skynet_stat_reset(struct skynet_stat *s) {
+	int i;
+	for (i=0;i<STAT_TYPES;i++) {
+		skynet_free(s->type[i]);
+	}
+	skynet_free(s->buffer);
+	skynet_stat_init(s);
+}
+
+static inline void
+hist_add(struct stat_histogram *h, uint64_t ns) {
+	uint64_t us = ns / 1000;
+	int b = 0;
+	if (us > 0) {
+		b = 64 - __builtin_clzll(us);
+		if (b >= STAT_BUCKETS)
+			b = STAT_BUCKETS - 1;
+	}
+	++h->bucket[b];
+	h->sum += ns;
+}
+
+void
+skynet_stat_record(struct skynet_stat *s, int type, uint64_t wait, uint64_t cb) {
+	if (type >= STAT_TYPES)
+		type = STAT_TYPES - 1;
+	struct stat_type *t = s->type[type];
+	if (t == NULL) {
+		t = skynet_malloc(sizeof(*t));
+		memset(t, 0, sizeof(*t));
+		s->type[type] = t;
+	}
+	++t->count;
+	hist_add(&t->wait, wait);
+	hist_add(&t->cb, cb);
+}
+
+static int
+dump_hist(char *buf, struct stat_histogram *h) {
+	int n = 0;
+	int i;
+	for (i=0;i<STAT_BUCKETS;i++) {
+		if (h->bucket[i]) {
+			n += sprintf(buf + n, "%s%d:%u", n ? "," : "", i, h->bucket[i]);
+		}
+	}
+	if (n == 0) {
+		buf[n++] = '-';
+		buf[n] = '\0';
+	}
+	return n;
+}
+
+const char *
+skynet_stat_dump(struct skynet_stat *s) {
+	// a line is at most 64 + 2 * STAT_BUCKETS * 16 bytes
+	int need = STAT_TYPES * (64 + 2 * STAT_BUCKETS * 16) + 1;
+	if (s->cap < need) {
+		skynet_free(s->buffer);
+		s->buffer = skynet_malloc(need);
+		s->cap = need;
+	}
+	char *buf = s->buffer;
+	int n = 0;
+	int i;
+	for (i=0;i<STAT_TYPES;i++) {
+		struct stat_type *t = s->type[i];
+		if (t == NULL)
+			continue;
+		n += sprintf(buf + n, "%d %llu %llu %llu ", i, (unsigned long long)t->count,
+			(unsigned long long)(t->wait.sum / 1000), (unsigned long long)(t->cb.sum / 1000));
+		n += dump_hist(buf + n, &t->wait);
+		buf[n++] = ' ';
+		n += dump_hist(buf + n, &t->cb);
+		buf[n++] = '\n';
+	}
+	buf[n] = '\0';
+	return buf;
+}
@@ -0,0 +1,34 @@
+#ifndef skynet_stat_h
+#define skynet_stat_h
+
+#include <stdint.h>
+
+#define STAT_BUCKETS 32
+#define STAT_TYPES 16	// message types >= STAT_TYPES - 1 share the last slot
+
+struct stat_histogram {
+	uint32_t bucket[STAT_BUCKETS];	// bucket[0] : < 1us , bucket[i] : [2^(i-1), 2^i) us
+	uint64_t sum;	// in nanosec
+};
+
+struct stat_type {
+	uint64_t count;
+	struct stat_histogram wait;	// from enqueue to dispatch
+	struct stat_histogram cb;	// time in the callback
+};
+
+// per service, only the thread dispatching the service writes it, so no lock
+struct skynet_stat {
+	struct stat_type *type[STAT_TYPES];
+	char *buffer;	// for skynet_stat_dump
+	int cap;
+};
+
+void skynet_stat_init(struct skynet_stat *s);
+void skynet_stat_reset(struct skynet_stat *s);	// free the histograms when the service exits
+void skynet_stat_record(struct skynet_stat *s, int type, uint64_t wait, uint64_t cb);	// in nanosec
+// one line per message type : "type count wait_sum cb_sum wait_buckets cb_buckets" (sum in microsec),
+// buckets is "i:n,i:n" with the non-empty buckets only, or "-"
+const char * skynet_stat_dump(struct skynet_stat *s);
+
+#endif
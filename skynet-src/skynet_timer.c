@@ -5,20 +5,27 @@
 #include "skynet_server.h"
 #include "skynet_handle.h"
 #include "spinlock.h"
+#include "atomic.h"
 
+#include <pthread.h>
 #include <time.h>
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <limits.h>
 
 #if defined(__APPLE__)
 #include <AvailabilityMacros.h>
 #include <sys/time.h>
 #include <mach/task.h>
 #include <mach/mach.h>
+#include <unistd.h>
 #endif
 
+
+//刻度默认10ms (config 里的 timer_resolution，毫秒，可以是 1/2/5/10)，下面按10ms说
 //255*10ms=2550ms=2.55s=255个skynet单位时间,0~255对应near[0]~near[255]
 //32位分第1~8,9~14,15~20,21~26,27~32位的，5个级别，分别对应t[3][0],t[0],t[1],t[2],t[3],相差0~2.55s以内存near,大于2.55s存单位刻度向量t
 //uint32_t溢出之后就是0，即移动move_list()t[3][0]，t[3][0]表示add_node()中相差全为0，即第一个256个刻度向量那个数组，和其他数组move_list()机制一样，相差<=2.55s存near，准备处理派发消息
@@ -31,19 +38,73 @@ typedef void (*timer_execute_func)(void *ud,void *arg);
 #define TIME_LEVEL (1 << TIME_LEVEL_SHIFT) //1000000
 #define TIME_NEAR_MASK (TIME_NEAR-1) //11111111 255
 #define TIME_LEVEL_MASK (TIME_LEVEL-1) //111111
+#define TIMER_SLAB_SIZE 1024
+#define TIMER_NODE_SIZE (sizeof(struct timer_node) + sizeof(struct timer_event))
+#define TIMER_CACHE 16	// timer_set 每次从 freelist 取多少个节点
+#define TIMER_SHARD 16	// 按 handle 分 inbox
+#define DEFAULT_SET_SIZE 16
+
+#define TIMER_PENDING 0
+#define TIMER_CANCELLED 1
+#define TIMER_FIRED 2
+#define TIMER_STATE_MASK 3
 
 struct timer_event {
 	uint32_t handle;
 	int session;
 };
 
+/*
+时间轮只有 timer 线程读写，不加锁。节点挂在刻度上的双向环形链表里。
+工作线程加定时器时把节点用 CAS 压进 handle 所在 shard 的 inbox，timer 线程走刻度和睡眠前把所有 inbox 取下来并进时间轮。
+session 就是 timer id：服务在自己的 timer_set 里按 session 记下节点和分配时的 state，
+取消时把 state 从 PENDING CAS 成 CANCELLED，再把节点压进 shard 的取消栈，由 timer 线程摘下回收；
+timer 线程派发前同样把 state CAS 成 FIRED，两边只有一个会成功，所以取消的结果是确定的。
+节点不还给系统，state 高位是分配次数 (gen)，过期的记录不会误伤复用后的节点。
+*/
 struct timer_node {
 	struct timer_node *next;
+	struct timer_node *prev;
+	struct timer_node *cnext; // 取消栈
 	uint32_t expire; //超时时间
+	int linked; // 在时间轮里，只有 timer 线程读写
+	ATOM_ULONG state; // gen << 2 | TIMER_PENDING/TIMER_CANCELLED/TIMER_FIRED
+};
+
+struct timer_shard {
+	ATOM_POINTER inbox;	// 新加的节点，按 next 串
+	ATOM_POINTER cancel;	// 取消的节点，按 cnext 串
+	char pad[64 - 2 * sizeof(ATOM_POINTER)];	// 各 shard 不共享 cache line
+};
+
+struct timer_ref {
+	int session;	// 0 表示空
+	unsigned long state;
+	struct timer_node *node;
+};
+
+// 一个服务的未到期定时器，只有服务自己 (TIMEOUT/CANCEL) 读写
+struct timer_set {
+	struct timer_ref *slot;	// 按 session 开放寻址
+	int cap;	// 2^n
+	int count;
+	struct timer_node *cache;	// 从 freelist 取来还没用的节点
 };
 
 struct link_list {
-	struct timer_node head;
+	struct timer_node head;	// 哨兵
+};
+
+/*
+节点从 freelist 分配，不够时一次 malloc TIMER_SLAB_SIZE 个，用完放回 freelist，不还给系统。
+服务一次取 TIMER_CACHE 个放在自己的 timer_set 里，加定时器时很少碰 freelist 的锁。
+同一刻度到期的节点按 handle 分组，每个服务只 grab 一次，一次加锁把这组消息都压进它的队列 (skynet_context_push_n)，
+同一服务的消息顺序不变。分组用的散列表和消息数组只有 timer 线程用，不用加锁。
+*/
+struct timer_group {
+	uint32_t handle;
+	int n;
+	struct timer_node *head;
 	struct timer_node *tail;
 };
 
@@ -52,29 +113,73 @@ struct timer {
 	struct link_list t[4][TIME_LEVEL]; // 6位 64 只有t[3]用64个,其他只用63个，
 										//t[3][0] 0~255单位刻度向量 t[0] 256~16383单位刻度向量 t[1] 16384~1048576单位刻度向量 
 										//t[2] 1048577~67108863单位刻度向量 t[3] 67108864~4294967295单位刻度向量
-	struct spinlock lock;
-	uint32_t time;
+	struct timer_shard shard[TIMER_SHARD];
+	struct spinlock lock;      // 只保护 freelist
+	uint32_t time;             // 刻度数，只有 timer 线程读写
 	uint32_t starttime;
-	uint64_t current;
-	uint64_t current_point;
+	int tick;                  // 一个刻度多少毫秒
+	uint64_t current;          // 毫秒，只按整刻度前进
+	uint64_t current_point;    // gettime() 上次走刻度时的值，毫秒
+	uint64_t origin; // skynet_now_ms() == gettime() + origin
+	ATOM_ULONG base; // current_point - time * tick ，工作线程用它算当前是第几个刻度
+	struct timer_node *freelist;
+	// dispatch_list 的临时空间
+	struct timer_group *group;
+	int group_cap;
+	int *group_slot;           // handle -> group index + 1, 开放寻址
+	int slot_cap;              // 2^n
+	struct skynet_message *msg; // group_cap 个
+	// timer 线程睡到 wake 这个刻度，timer_add 加了更早的节点时唤醒它
+	ATOM_INT sleep;
+	ATOM_INT wake;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
 };
 
 static struct timer * TI = NULL;
 
+static uint64_t gettime();
+
+static inline void
+link_init(struct link_list *list) {
+	list->head.next = &list->head;
+	list->head.prev = &list->head;
+}
+
+static inline int
+link_empty(struct link_list *list) {
+	return list->head.next == &list->head;
+}
+
+// 摘下整条链表，返回以 NULL 结尾的单链
 static inline struct timer_node *
 link_clear(struct link_list *list) {
+	if (link_empty(list))
+		return NULL;
 	struct timer_node * ret = list->head.next;
-	list->head.next = 0;
-	list->tail = &(list->head);
+	list->head.prev->next = NULL;
+	link_init(list);
 
 	return ret;
 }
 
 static inline void
 link(struct link_list *list,struct timer_node *node) {
-	list->tail->next = node;
-	list->tail = node;
-	node->next=0;
+	node->prev = list->head.prev;
+	node->next = &list->head;
+	list->head.prev->next = node;
+	list->head.prev = node;
+}
+
+static inline void
+unlink_node(struct timer_node *node) {
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
+}
+
+static inline struct timer_event *
+node_event(struct timer_node *node) {
+	return (struct timer_event *)(node+1);
 }
 
 static void
@@ -100,17 +205,261 @@ add_node(struct timer *T,struct timer_node *node) {
 	}
 }
 
-static void
-timer_add(struct timer *T,void *arg,size_t sz,int time) {
-	struct timer_node *node = (struct timer_node *)skynet_malloc(sizeof(*node)+sz);
-	memcpy(node+1,arg,sz); // node->next = arg
+static struct timer_node *
+node_alloc(struct timer *T, struct timer_set *set) {
+	struct timer_node *node = set->cache;
+	if (node == NULL) {
+		SPIN_LOCK(T);
+		if (T->freelist == NULL) {
+			char *slab = skynet_malloc(TIMER_SLAB_SIZE * TIMER_NODE_SIZE);
+			int i;
+			for (i=0;i<TIMER_SLAB_SIZE;i++) {
+				struct timer_node *n = (struct timer_node *)(slab + i * TIMER_NODE_SIZE);
+				ATOM_INIT(&n->state, 0);
+				n->next = T->freelist;
+				T->freelist = n;
+			}
+		}
+		// take a few nodes at once, so the lock is rare
+		node = T->freelist;
+		struct timer_node *tail = node;
+		int i;
+		for (i=1;i<TIMER_CACHE && tail->next;i++) {
+			tail = tail->next;
+		}
+		T->freelist = tail->next;
+		tail->next = NULL;
+		SPIN_UNLOCK(T);
+	}
+	set->cache = node->next;
+	return node;
+}
 
+// give back the list from head to tail in one lock
+static void
+node_free(struct timer *T, struct timer_node *head, struct timer_node *tail) {
 	SPIN_LOCK(T);
+	tail->next = T->freelist;
+	T->freelist = head;
+	SPIN_UNLOCK(T);
+}
 
-		node->expire=time+T->time;
-		add_node(T,node);
+static inline uint32_t
+set_pos(struct timer_set *set, int session) {
+	return ((uint32_t)session * 2654435761u) & (set->cap - 1);
+}
 
-	SPIN_UNLOCK(T);
+static inline int
+ref_alive(struct timer_ref *ref) {
+	return ATOM_LOAD(&ref->node->state) == ref->state;
+}
+
+static struct timer_ref *
+set_find(struct timer_set *set, int session) {
+	if (set->count == 0)
+		return NULL;
+	uint32_t pos = set_pos(set, session);
+	while (set->slot[pos].session) {
+		if (set->slot[pos].session == session)
+			return &set->slot[pos];
+		pos = (pos + 1) & (set->cap - 1);
+	}
+	return NULL;
+}
+
+static void
+set_remove(struct timer_set *set, struct timer_ref *ref) {
+	// shift the following refs back, no tombstone
+	uint32_t mask = set->cap - 1;
+	uint32_t hole = ref - set->slot;
+	uint32_t pos = hole;
+	for (;;) {
+		pos = (pos + 1) & mask;
+		struct timer_ref *r = &set->slot[pos];
+		if (r->session == 0)
+			break;
+		uint32_t home = set_pos(set, r->session);
+		if (((pos - home) & mask) >= ((pos - hole) & mask)) {
+			set->slot[hole] = *r;
+			hole = pos;
+		}
+	}
+	set->slot[hole].session = 0;
+	--set->count;
+}
+
+// drop the refs of fired timers, and grow if it's still crowded
+static void
+set_rehash(struct timer_set *set) {
+	struct timer_ref *old = set->slot;
+	int oldcap = set->cap;
+	int live = 0;
+	int i;
+	for (i=0;i<oldcap;i++) {
+		if (old[i].session && ref_alive(&old[i]))
+			++live;
+	}
+	int cap = oldcap ? oldcap : DEFAULT_SET_SIZE;
+	while ((live + 1) * 4 > cap)
+		cap *= 2;
+	set->slot = skynet_malloc(cap * sizeof(struct timer_ref));
+	memset(set->slot, 0, cap * sizeof(struct timer_ref));
+	set->cap = cap;
+	set->count = live;
+	for (i=0;i<oldcap;i++) {
+		if (old[i].session && ref_alive(&old[i])) {
+			uint32_t pos = set_pos(set, old[i].session);
+			while (set->slot[pos].session)
+				pos = (pos + 1) & (cap - 1);
+			set->slot[pos] = old[i];
+		}
+	}
+	skynet_free(old);
+}
+
+static void
+set_insert(struct timer_set *set, int session, struct timer_node *node, unsigned long state) {
+	if ((set->count + 1) * 2 > set->cap) {
+		set_rehash(set);
+	}
+	uint32_t pos = set_pos(set, session);
+	while (set->slot[pos].session)
+		pos = (pos + 1) & (set->cap - 1);
+	struct timer_ref *ref = &set->slot[pos];
+	ref->session = session;
+	ref->state = state;
+	ref->node = node;
+	++set->count;
+}
+
+static inline void
+inbox_push(struct timer_shard *s, struct timer_node *node) {
+	uintptr_t old;
+	do {
+		old = ATOM_LOAD(&s->inbox);
+		node->next = (struct timer_node *)old;
+	} while (!ATOM_CAS_POINTER(&s->inbox, old, (uintptr_t)node));
+}
+
+static inline void
+cancel_push(struct timer_shard *s, struct timer_node *node) {
+	uintptr_t old;
+	do {
+		old = ATOM_LOAD(&s->cancel);
+		node->cnext = (struct timer_node *)old;
+	} while (!ATOM_CAS_POINTER(&s->cancel, old, (uintptr_t)node));
+}
+
+// take the whole stack
+static inline struct timer_node *
+stack_take(ATOM_POINTER *top) {
+	uintptr_t old;
+	do {
+		old = ATOM_LOAD(top);
+		if (old == 0)
+			break;
+	} while (!ATOM_CAS_POINTER(top, old, 0));
+	return (struct timer_node *)old;
+}
+
+static void
+timer_add(struct timer *T, struct timer_set *set, struct timer_event *event, int time) {
+	struct timer_node *node = node_alloc(T, set);
+	memcpy(node+1,event,sizeof(*event)); // node_event(node)
+	unsigned long state = ((ATOM_LOAD(&node->state) >> 2) + 1) << 2;	// next gen, TIMER_PENDING
+	ATOM_STORE(&node->state, state);
+	node->linked = 0;
+
+	// T->time may lag behind when the timer thread is sleeping, count the tick from the clock
+	uint32_t now = (uint32_t)((gettime() - ATOM_LOAD(&T->base)) / T->tick);
+	uint32_t expire = now + time;
+	node->expire = expire;
+	set_insert(set, event->session, node, state);
+	inbox_push(&T->shard[event->handle % TIMER_SHARD], node);
+
+	if (ATOM_LOAD(&T->sleep) && (int32_t)(expire - (uint32_t)ATOM_LOAD(&T->wake)) < 0) {
+		// earlier than the timer thread expected
+		pthread_mutex_lock(&T->mutex);
+		if (ATOM_LOAD(&T->sleep) && (int32_t)(expire - (uint32_t)ATOM_LOAD(&T->wake)) < 0) {
+			ATOM_STORE(&T->sleep, 0);
+			pthread_cond_signal(&T->cond);
+		}
+		pthread_mutex_unlock(&T->mutex);
+	}
+}
+
+// 把 inbox 并进时间轮，回收取消的节点
+static void
+timer_merge(struct timer *T) {
+	struct timer_node *head = NULL;
+	struct timer_node *tail = NULL;
+	int i;
+	for (i=0;i<TIMER_SHARD;i++) {
+		struct timer_shard *s = &T->shard[i];
+		// take the cancel stack first, the nodes in it are pushed into the inbox before, they are in the inbox we take next or in the wheel
+		struct timer_node *cancel = stack_take(&s->cancel);
+		struct timer_node *node = stack_take(&s->inbox);
+		// reverse it, keep the order of timer_add
+		struct timer_node *list = NULL;
+		while (node) {
+			struct timer_node *next = node->next;
+			node->next = list;
+			list = node;
+			node = next;
+		}
+		while (list) {
+			struct timer_node *next = list->next;
+			if ((ATOM_LOAD(&list->state) & TIMER_STATE_MASK) == TIMER_PENDING) {
+				if ((int32_t)(list->expire - T->time) <= 0) {
+					// the tick is passed before merge
+					list->expire = T->time + 1;
+				}
+				add_node(T, list);
+				list->linked = 1;
+			}
+			list = next;
+		}
+		while (cancel) {
+			struct timer_node *next = cancel->cnext;
+			if (cancel->linked) {
+				unlink_node(cancel);
+				cancel->linked = 0;
+			}
+			cancel->next = head;
+			if (head == NULL)
+				tail = cancel;
+			head = cancel;
+			cancel = next;
+		}
+	}
+	if (head) {
+		node_free(T, head, tail);
+	}
+}
+
+static int
+inbox_empty(struct timer *T) {
+	int i;
+	for (i=0;i<TIMER_SHARD;i++) {
+		if (ATOM_LOAD(&T->shard[i].inbox))
+			return 0;
+	}
+	return 1;
+}
+
+// 距离下一个可能到期的刻度还有几个刻度：near 里当前一轮之内第一个非空的槽，
+// 没有的话就是下一轮开始 (t[] 的节点可能在那时移进 near)
+static uint32_t
+next_expire(struct timer *T) {
+	uint32_t ct = T->time;
+	uint32_t i;
+	uint32_t n = TIME_NEAR - (ct & TIME_NEAR_MASK);
+	for (i=1;i<n;i++) {
+		if (!link_empty(&T->near[(ct + i) & TIME_NEAR_MASK])) {
+			return i;
+		}
+	}
+	return n;
 }
 
 static void
@@ -147,49 +496,158 @@ timer_shift(struct timer *T) {
 }
 
 static inline void
-dispatch_list(struct timer_node *current) {
-	do {
-		struct timer_event * event = (struct timer_event *)(current+1);
+timer_message(struct skynet_message *message, struct timer_event *event) {
+	message->source = 0;
+	message->session = event->session;
+	message->data = NULL;
+	message->sz = (size_t)PTYPE_RESPONSE << MESSAGE_TYPE_SHIFT;
+}
+
+static void
+reserve_dispatch(struct timer *T, int n) {
+	if (n > T->group_cap) {
+		int cap = T->group_cap;
+		while (cap < n)
+			cap *= 2;
+		skynet_free(T->group);
+		skynet_free(T->msg);
+		T->group = skynet_malloc(cap * sizeof(struct timer_group));
+		T->msg = skynet_malloc(cap * sizeof(struct skynet_message));
+		T->group_cap = cap;
+	}
+	int slot = T->slot_cap;
+	while (slot < n * 2)
+		slot *= 2;
+	if (slot != T->slot_cap) {
+		skynet_free(T->group_slot);
+		T->group_slot = skynet_malloc(slot * sizeof(int));
+		T->slot_cap = slot;
+	}
+}
+
+// group the nodes by handle, return the number of groups
+static int
+group_list(struct timer *T, struct timer_node *current, int n) {
+	reserve_dispatch(T, n);
+	int mask = T->slot_cap - 1;
+	// only clear the part we use
+	while (mask + 1 > n * 4 && mask > 1)
+		mask >>= 1;
+	memset(T->group_slot, 0, (mask + 1) * sizeof(int));
+	int ngroup = 0;
+	while (current) {
+		struct timer_node *next = current->next;
+		uint32_t handle = node_event(current)->handle;
+		int pos = (handle * 2654435761u) & mask;
+		struct timer_group *g = NULL;
+		while (T->group_slot[pos]) {
+			g = &T->group[T->group_slot[pos]-1];
+			if (g->handle == handle)
+				break;
+			g = NULL;
+			pos = (pos + 1) & mask;
+		}
+		current->next = NULL;
+		if (g == NULL) {
+			g = &T->group[ngroup++];
+			T->group_slot[pos] = ngroup;
+			g->handle = handle;
+			g->n = 0;
+			g->head = current;
+		} else {
+			g->tail->next = current;
+		}
+		g->tail = current;
+		++g->n;
+		current = next;
+	}
+	return ngroup;
+}
+
+static void
+dispatch_list(struct timer *T, struct timer_node *current) {
+	int n = 0;
+	struct timer_node *node;
+	struct timer_node *tail = NULL;
+	for (node = current; node; node = node->next) {
+		++n;
+		tail = node;
+	}
+	if (n == 1) {
 		struct skynet_message message;
-		message.source = 0;
-		message.session = event->session;
-		message.data = NULL;
-		message.sz = (size_t)PTYPE_RESPONSE << MESSAGE_TYPE_SHIFT;
+		timer_message(&message, node_event(current));
+		skynet_context_push(node_event(current)->handle, &message);
+	} else {
+		int ngroup = group_list(T, current, n);
+		int i;
+		for (i=0;i<ngroup;i++) {
+			struct timer_group *g = &T->group[i];
+			int j = 0;
+			for (node = g->head; node; node = node->next) {
+				timer_message(&T->msg[j++], node_event(node));
+			}
+			skynet_context_push_n(g->handle, T->msg, g->n);
+			if (i > 0) {
+				T->group[i-1].tail->next = g->head;
+			}
+		}
+		current = T->group[0].head;
+		tail = T->group[ngroup-1].tail;
+	}
+	// give back all the nodes in one lock
+	node_free(T, current, tail);
+}
 
-		skynet_context_push(event->handle, &message);
-		
-		struct timer_node * temp = current;
-		current=current->next;
-		skynet_free(temp);	
-	} while (current);
+// PENDING -> FIRED, fail if it's cancelled
+static inline int
+node_fire(struct timer_node *node) {
+	unsigned long state = ATOM_LOAD(&node->state);
+	while ((state & TIMER_STATE_MASK) == TIMER_PENDING) {
+		if (ATOM_CAS(&node->state, state, state | TIMER_FIRED))
+			return 1;
+		state = ATOM_LOAD(&node->state);
+	}
+	return 0;
 }
 
 static inline void
 timer_execute(struct timer *T) {
 	int idx = T->time & TIME_NEAR_MASK;
 	
-	while (T->near[idx].head.next) {
+	while (!link_empty(&T->near[idx])) {
 		struct timer_node *current = link_clear(&T->near[idx]);
-		SPIN_UNLOCK(T);
-		// dispatch_list don't need lock T
-		dispatch_list(current);
-		SPIN_LOCK(T);
+		// skip the cancelled nodes, timer_merge gives them back from the cancel stack
+		struct timer_node *list = NULL;
+		struct timer_node **tail = &list;
+		while (current) {
+			struct timer_node *next = current->next;
+			current->linked = 0;
+			if (node_fire(current)) {
+				*tail = current;
+				tail = &current->next;
+			}
+			current = next;
+		}
+		*tail = NULL;
+		if (list) {
+			dispatch_list(T, list);
+		}
 	}
 }
 
 static void 
 timer_update(struct timer *T) {
-	SPIN_LOCK(T);
-
 	// try to dispatch timeout 0 (rare condition)
 	timer_execute(T);
 
+	// step current_point with time, base stays the same
+	T->current_point += T->tick;
+	T->current += T->tick;
+
 	// shift time first, and then dispatch timer message
 	timer_shift(T);
 
 	timer_execute(T);
-
-	SPIN_UNLOCK(T);
 }
 
 static struct timer *
@@ -200,24 +658,48 @@ timer_create_timer() {
 	int i,j;
 
 	for (i=0;i<TIME_NEAR;i++) { //256
-		link_clear(&r->near[i]); //255 link_list 切断
+		link_init(&r->near[i]);
 	}
 
 	for (i=0;i<4;i++) {
 		for (j=0;j<TIME_LEVEL;j++) {
-			link_clear(&r->t[i][j]); //4*255 link_list
+			link_init(&r->t[i][j]); //4*64 link_list
 		}
 	}
 
 	SPIN_INIT(r)
 
+	for (i=0;i<TIMER_SHARD;i++) {
+		ATOM_INIT(&r->shard[i].inbox, 0);
+		ATOM_INIT(&r->shard[i].cancel, 0);
+	}
+	r->freelist = NULL;
+	r->group_cap = 16;
+	r->group = skynet_malloc(r->group_cap * sizeof(struct timer_group));
+	r->msg = skynet_malloc(r->group_cap * sizeof(struct skynet_message));
+	r->slot_cap = 32;
+	r->group_slot = skynet_malloc(r->slot_cap * sizeof(int));
+
 	r->current = 0;
+	ATOM_INIT(&r->sleep, 0);
+	ATOM_INIT(&r->wake, 0);
+
+	pthread_mutex_init(&r->mutex, NULL);
+#if !defined(__APPLE__)
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&r->cond, &attr);
+	pthread_condattr_destroy(&attr);
+#else
+	pthread_cond_init(&r->cond, NULL);
+#endif
 
 	return r;
 }
 
-int
-skynet_timeout(uint32_t handle, int time, int session) {
+static int
+timeout_ticks(struct timer_set *set, uint32_t handle, int64_t time, int session) {
 	if (time <= 0) { //立即执行
 		struct skynet_message message;
 		message.source = 0; //没有服务来源，框架消息
@@ -232,12 +714,73 @@ skynet_timeout(uint32_t handle, int time, int session) {
 		struct timer_event event;
 		event.handle = handle;
 		event.session = session;
-		timer_add(TI, &event, sizeof(event), time); //TI struct timer
+		if (time > INT_MAX)
+			time = INT_MAX;
+		timer_add(TI, set, &event, (int)time); //TI struct timer
 	}
 
 	return session;
 }
 
+// time 单位是 1/100 秒
+int
+skynet_timeout(struct timer_set *set, uint32_t handle, int time, int session) {
+	return timeout_ticks(set, handle, (int64_t)time * 10 / TI->tick, session);
+}
+
+// 按刻度向上取整
+int
+skynet_timeout_ms(struct timer_set *set, uint32_t handle, int ms, int session) {
+	int64_t time = ms;
+	if (time > 0) {
+		time = (time + TI->tick - 1) / TI->tick;
+	}
+	return timeout_ticks(set, handle, time, session);
+}
+
+int
+skynet_timer_cancel(struct timer_set *set, int session) {
+	struct timer_ref *ref = set_find(set, session);
+	if (ref == NULL)
+		return 0;
+	struct timer_node *node = ref->node;
+	unsigned long state = ref->state;
+	set_remove(set, ref);
+	unsigned long expect = state;
+	while (!ATOM_CAS(&node->state, expect, state | TIMER_CANCELLED)) {
+		if (expect != state) {
+			// fired
+			return 0;
+		}
+		expect = state;
+	}
+	cancel_push(&TI->shard[node_event(node)->handle % TIMER_SHARD], node);
+	return 1;
+}
+
+struct timer_set *
+skynet_timer_newset(void) {
+	struct timer_set *set = skynet_malloc(sizeof(*set));
+	memset(set, 0, sizeof(*set));
+	return set;
+}
+
+void
+skynet_timer_resetset(struct timer_set *set) {
+	skynet_free(set->slot);
+	set->slot = NULL;
+	set->cap = 0;
+	set->count = 0;
+	struct timer_node *head = set->cache;
+	if (head) {
+		struct timer_node *tail = head;
+		while (tail->next)
+			tail = tail->next;
+		node_free(TI, head, tail);
+		set->cache = NULL;
+	}
+}
+
 // centisecond: 1/100 second
 static void
 systime(uint32_t *sec, uint32_t *cs) {
@@ -258,17 +801,17 @@ systime(uint32_t *sec, uint32_t *cs) {
 //驱动是用这个，不受系统时间影响
 static uint64_t
 gettime() {
-	uint64_t t; //单位0.01s 10ms
+	uint64_t t; //单位毫秒
 #if !defined(__APPLE__) || defined(AVAILABLE_MAC_OS_X_VERSION_10_12_AND_LATER)
 	struct timespec ti;
 	clock_gettime(CLOCK_MONOTONIC, &ti); //运行时间，这个是time驱动，不受系统时间更变影响
-	t = (uint64_t)ti.tv_sec * 100;
-	t += ti.tv_nsec / 10000000;
+	t = (uint64_t)ti.tv_sec * 1000;
+	t += ti.tv_nsec / 1000000;
 #else
 	struct timeval tv;
 	gettimeofday(&tv, NULL);
-	t = (uint64_t)tv.tv_sec * 100;
-	t += tv.tv_usec / 10000;
+	t = (uint64_t)tv.tv_sec * 1000;
+	t += tv.tv_usec / 1000;
 #endif
 	return t;
 }
@@ -279,11 +822,12 @@ skynet_updatetime(void) {
 	if(cp < TI->current_point) {
 		skynet_error(NULL, "time diff error: change from %lld to %lld", cp, TI->current_point);
 		TI->current_point = cp;
-	} else if (cp != TI->current_point) {
-		uint32_t diff = (uint32_t)(cp - TI->current_point); //0.01秒==1
-		TI->current_point = cp;
-		TI->current += diff;
-		int i;
+		TI->origin = TI->current - cp;
+		ATOM_STORE(&TI->base, cp - (uint64_t)TI->time * TI->tick);
+	} else if (cp - TI->current_point >= TI->tick) {
+		uint32_t diff = (uint32_t)((cp - TI->current_point) / TI->tick); //刻度数，每走一个刻度 current_point 加一个刻度
+		uint32_t i;
+		timer_merge(TI);
 		for (i=0;i<diff;i++) {
 			timer_update(TI);
 		}
@@ -295,18 +839,69 @@ skynet_starttime(void) {
 	return TI->starttime;
 }
 
+// 不依赖 timer 线程更新，timer 线程空闲时会睡很久
 uint64_t 
 skynet_now(void) {
-	return TI->current;
+	return (gettime() + TI->origin) / 10;
+}
+
+uint64_t
+skynet_now_ms(void) {
+	return gettime() + TI->origin;
+}
+
+void
+skynet_timer_sleep(int maxms) {
+	struct timer *T = TI;
+#if !defined(__APPLE__)
+	pthread_mutex_lock(&T->mutex);
+	ATOM_STORE(&T->sleep, 1);
+	uint32_t n;
+	do {
+		// timer_add checks wake after pushing the node, merge again if it may read a stale wake
+		timer_merge(T);
+		n = next_expire(T);
+		ATOM_STORE(&T->wake, (int)(T->time + n));
+	} while (!inbox_empty(T));
+	// the wheel steps when gettime() reaches current_point + n ticks
+	uint64_t deadline = (T->current_point + (uint64_t)n * T->tick) * 1000000;
+
+	struct timespec ti;
+	clock_gettime(CLOCK_MONOTONIC, &ti);
+	uint64_t now = (uint64_t)ti.tv_sec * 1000000000 + ti.tv_nsec;
+	uint64_t limit = now + (uint64_t)maxms * 1000000;
+	if (deadline > limit) {
+		deadline = limit;
+	}
+	if (deadline > now) {
+		ti.tv_sec = deadline / 1000000000;
+		ti.tv_nsec = deadline % 1000000000;
+		pthread_cond_timedwait(&T->cond, &T->mutex, &ti);
+	}
+
+	ATOM_STORE(&T->sleep, 0);
+	pthread_mutex_unlock(&T->mutex);
+#else
+	(void)maxms;
+	usleep(2500);
+#endif
 }
 
 void 
-skynet_timer_init(void) {
+skynet_timer_init(int resolution) {
+	if (resolution <= 0 || resolution > 10 || 10 % resolution != 0) {
+		fprintf(stderr, "Invalid timer_resolution %d, should be 1, 2, 5 or 10 (ms)\n", resolution);
+		exit(1);
+	}
 	TI = timer_create_timer();
+	TI->tick = resolution;
 	uint32_t current = 0;
 	systime(&TI->starttime, &current); //starttime秒 current0.01秒
-	TI->current = current;
+	TI->current = (uint64_t)current * 10;
 	TI->current_point = gettime();
+	TI->origin = TI->current - TI->current_point;
+	ATOM_INIT(&TI->base, TI->current_point);
+
 }
 
 // for profile
@@ -331,3 +926,17 @@ skynet_thread_time(void) {
 	return (uint64_t)(aTaskInfo.user_time.seconds) + (uint64_t)aTaskInfo.user_time.microseconds;
 #endif
 }
+
+uint64_t
+skynet_hpc(void) {
+#if  !defined(__APPLE__) || defined(AVAILABLE_MAC_OS_X_VERSION_10_12_AND_LATER)
+	struct timespec ti;
+	clock_gettime(CLOCK_MONOTONIC, &ti);
+	return (uint64_t)ti.tv_sec * NANOSEC + (uint64_t)ti.tv_nsec;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * NANOSEC + (uint64_t)tv.tv_usec * (NANOSEC / MICROSEC);
+#endif
+}
+
@@ -3,11 +3,22 @@
 
 #include <stdint.h>
 
-int skynet_timeout(uint32_t handle, int time, int session);
+struct timer_set;
+
+// set keeps the timers of one service for cancel, only the service itself can use it
+int skynet_timeout(struct timer_set *set, uint32_t handle, int time, int session);
+int skynet_timeout_ms(struct timer_set *set, uint32_t handle, int ms, int session);	// round up to the timer resolution
+int skynet_timer_cancel(struct timer_set *set, int session);	// 1 if the timer is removed before it expires
+struct timer_set * skynet_timer_newset(void);
+void skynet_timer_resetset(struct timer_set *set);	// when the service exits
 void skynet_updatetime(void);
+void skynet_timer_sleep(int maxms);	// for timer thread, sleep until the next timer may expire
+
 uint32_t skynet_starttime(void);
 uint64_t skynet_thread_time(void);	// for profile, in micro second
+uint64_t skynet_hpc(void);	// monotonic high performance counter, in nano second
+
 
-void skynet_timer_init(void);
+void skynet_timer_init(int resolution);	// ms per tick, 1/2/5/10
 
 #endif
@@ -15,6 +15,7 @@ struct socket_info {
 	uint64_t opaque;
 	uint64_t read;
 	uint64_t write;
+	uint64_t wcount;
 	uint64_t rtime;
 	uint64_t wtime;
 	int64_t wbuffer;
@@ -24,6 +25,14 @@ struct socket_info {
 	struct socket_info *next;
 };
 
+struct socket_recvpool_stat {
+	uint64_t alloc;		// receive buffers
+	uint64_t reuse;		// taken from the pool
+	uint64_t copy;		// the data is copied to a smaller buffer
+	uint64_t recycle;	// given back by services
+	uint64_t cache;		// bytes cached in the pool now
+};
+
 struct socket_info * socket_info_create(struct socket_info *last);
 void socket_info_release(struct socket_info *);
 
@@ -8,6 +8,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/tcp.h>
 #include <unistd.h>
 #include <errno.h>
@@ -17,6 +18,11 @@
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <limits.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 
 #define MAX_INFO 128
 // MAX_SOCKET will be 2^MAX_SOCKET_P
@@ -59,6 +65,13 @@
 
 #define WARNING_SIZE (1024*1024)
 
+// һ writev  write_buffer 
+#ifdef IOV_MAX
+#define MAX_IOV IOV_MAX
+#else
+#define MAX_IOV 1024
+#endif
+
 #define USEROBJECT ((size_t)(-1))
 
 struct write_buffer {
@@ -83,6 +96,7 @@ struct socket_stat {
 	uint64_t wtime;
 	uint64_t read;
 	uint64_t write;
+	uint64_t wcount; // дϵͳô
 };
 
 struct socket {
@@ -110,13 +124,63 @@ struct socket {
 	size_t dw_size; // direct write С
 };
 
+#define CTRL_RING_SIZE 1024	//  2 
+
+// ջءforward_message_tcp ĻС recvpool_size(n)n ݳȣ
+// ԷֻƾϢȾܰضӦߴĳأ socket_server_recycle
+#define RECVPOOL_MIN_P 6	// 2^6 == MIN_READ_BUFFER
+#define RECVPOOL_MAX_P 16	// Ļֱ malloc/free
+#define RECVPOOL_CLASS (RECVPOOL_MAX_P - RECVPOOL_MIN_P + 1)
+#define RECVPOOL_CACHE (1024*1024)	// ÿ socket ߳ÿֳߴ໺ֽ
+
+struct recvpool_node {
+	struct recvpool_node *next;
+};
+
+// ֻ socket ̶߳д
+struct recvpool {
+	struct recvpool_node *free;
+	int n;
+};
+
+// 񻹻Ļ socket ̹߳áʱ pushsocket ߳һȡջ
+static ATOM_POINTER RECVPOOL_RETURN[RECVPOOL_CLASS];
+
+// ̷߳ socket ̵߳seq дλʱУдλ + 1 ʱɶ
+struct ctrl_slot {
+	ATOM_ULONG seq;
+	uint8_t type;
+	uint8_t len;
+	uint8_t buffer[256];
+};
+
+// ring Ժϣworker ߳Զ
+struct ctrl_overflow {
+	struct ctrl_overflow *next;
+	uint8_t type;
+	uint8_t len;
+	uint8_t buffer[1];
+};
+
 struct socket_server {
 	volatile uint64_t time;
-	int recvctrl_fd; // չܵϢļ
-	int sendctrl_fd; // ͹ܵϢļ
-	int checkctrl; // жǷ߳ͨܵsocket̷߳ϢıǱ
+	int recvctrl_fd; // linux  eventfdƽ̨ǹܵĶˣֻ socket ߳
+	int sendctrl_fd; // eventfd ʱ recvctrl_fd ͬ
+	int checkctrl; // жǷ߳ socket ̷߳ıǱ
+	ATOM_INT ctrl_signal; // Ѿѹ socket ̣߳ն֮ǰд recvctrl_fd
+	ATOM_INT ctrl_overflowing; // overflow գʱ󶼽֤ͬһ̵߳
+	ATOM_ULONG ctrl_tail; // ߣ̣߳дλ
+	unsigned long ctrl_head; // ֻ socket ̶߳д
+	struct spinlock ctrl_lock; //  overflow 
+	struct ctrl_overflow *overflow_head;
+	struct ctrl_overflow *overflow_tail;
 	poll_fd event_fd; // epollʵid
 	ATOM_INT alloc_id; // Ѿsocket slotбid
+	int id_base; //  socket ߳ʱid ĸλǱ socket_server  group е
+	int id_mask;
+	struct socket_server **group; //  socket ̵߳ socket_serveraccept ָ
+	int group_n;
+	int accept_next;
 	int event_n; // Ǳepoll¼
 	int event_index; // һδepoll¼
 	struct socket_object_interface soi; // for package sz == -1
@@ -124,7 +188,9 @@ struct socket_server {
 	struct socket slot[MAX_SOCKET]; // socket б
 	char buffer[MAX_INFO]; // ַϢתַԺ󣬴
 	uint8_t udpbuffer[MAX_UDP_PACKAGE];
-	fd_set rfds;
+	struct ctrl_slot ctrl[CTRL_RING_SIZE]; // Уߵ
+	struct recvpool recvpool[RECVPOOL_CLASS];
+	struct socket_recvpool_stat recvstat;
 };
 
 struct request_open {
@@ -193,6 +259,7 @@ struct request_udp {
 	S Start socket
 	B Bind socket
 	L Listen socket
+	H Hand over an accepted socket (from the socket_server of the listen socket)
 	K Close socket
 	O Connect to (Open)
 	X Exit
@@ -206,7 +273,6 @@ struct request_udp {
  */
 
 struct request_package {
-	uint8_t header[8];	// 6 bytes dummy
 	union {
 		char buffer[256];
 		struct request_open open;
@@ -349,6 +415,7 @@ reserve_id(struct socket_server *ss) {
 		if (id < 0) {
 			id = ATOM_FAND(&(ss->alloc_id), 0x7fffffff) & 0x7fffffff; // ȡ -0x7fffffff == 0
 		}
+		id = (id & ss->id_mask) | ss->id_base;
 		struct socket *s = &ss->slot[HASH_ID(id)];
 		unsigned char type_invalid = ATOM_LOAD(&s->type);
 		if (type_invalid == SOCKET_TYPE_INVALID) {
@@ -375,6 +442,133 @@ clear_wb_list(struct wb_list *list) {
 	list->tail = NULL;
 }
 
+static inline int
+recvpool_class(int sz) {
+	int c = 0;
+	while ((MIN_READ_BUFFER << c) < sz)
+		++c;
+	return c;
+}
+
+//  n ֽݵĻС
+static inline int
+recvpool_size(int n) {
+	return MIN_READ_BUFFER << recvpool_class(n);
+}
+
+static inline int
+recvpool_limit(int c) {
+	return RECVPOOL_CACHE >> (c + RECVPOOL_MIN_P);
+}
+
+// take the whole return stack
+static inline struct recvpool_node *
+recvpool_take(int c) {
+	uintptr_t old;
+	do {
+		old = ATOM_LOAD(&RECVPOOL_RETURN[c]);
+		if (old == 0)
+			break;
+	} while (!ATOM_CAS_POINTER(&RECVPOOL_RETURN[c], old, 0));
+	return (struct recvpool_node *)old;
+}
+
+static void
+recvpool_release(struct recvpool_node *node) {
+	while (node) {
+		struct recvpool_node *next = node->next;
+		FREE(node);
+		node = next;
+	}
+}
+
+// ̵߳ĳؿˣѷ񻹻Ļù޵ͷŵ
+static void
+recvpool_refill(struct socket_server *ss, int c) {
+	struct recvpool *p = &ss->recvpool[c];
+	struct recvpool_node *node = recvpool_take(c);
+	int limit = recvpool_limit(c);
+	while (node) {
+		struct recvpool_node *next = node->next;
+		++ss->recvstat.recycle;
+		if (p->n < limit) {
+			node->next = p->free;
+			p->free = node;
+			++p->n;
+		} else {
+			FREE(node);
+		}
+		node = next;
+	}
+}
+
+// sz  recvpool_size ķֵs->p.size 
+static char *
+recvpool_alloc(struct socket_server *ss, int sz) {
+	int c = recvpool_class(sz);
+	++ss->recvstat.alloc;
+	if (c < RECVPOOL_CLASS) {
+		struct recvpool *p = &ss->recvpool[c];
+		if (p->free == NULL) {
+			recvpool_refill(ss, c);
+		}
+		struct recvpool_node *node = p->free;
+		if (node) {
+			p->free = node->next;
+			--p->n;
+			++ss->recvstat.reuse;
+			return (char *)node;
+		}
+	}
+	return MALLOC(sz);
+}
+
+// socket ߳ԼĻ
+static void
+recvpool_free(struct socket_server *ss, char *buffer, int sz) {
+	int c = recvpool_class(sz);
+	if (c < RECVPOOL_CLASS) {
+		struct recvpool *p = &ss->recvpool[c];
+		if (p->n < recvpool_limit(c)) {
+			struct recvpool_node *node = (struct recvpool_node *)buffer;
+			node->next = p->free;
+			p->free = node;
+			++p->n;
+			return;
+		}
+	}
+	FREE(buffer);
+}
+
+// κ̶߳Եãbuffer  SOCKET_DATA Ϣݣsz ݳ
+void
+socket_server_recycle(void *buffer, int sz) {
+	int c = recvpool_class(sz);
+	if (c >= RECVPOOL_CLASS) {
+		FREE(buffer);
+		return;
+	}
+	struct recvpool_node *node = buffer;
+	uintptr_t old;
+	do {
+		old = ATOM_LOAD(&RECVPOOL_RETURN[c]);
+		node->next = (struct recvpool_node *)old;
+	} while (!ATOM_CAS_POINTER(&RECVPOOL_RETURN[c], old, (uintptr_t)node));
+}
+
+// ۼӵ stat ϣ socket ߳ʱɵ߻
+void
+socket_server_recvpool(struct socket_server *ss, struct socket_recvpool_stat *stat) {
+	int i;
+	stat->alloc += ss->recvstat.alloc;
+	stat->reuse += ss->recvstat.reuse;
+	stat->copy += ss->recvstat.copy;
+	stat->recycle += ss->recvstat.recycle;
+	for (i=0;i<RECVPOOL_CLASS;i++) {
+		stat->cache += (uint64_t)ss->recvpool[i].n << (i + RECVPOOL_MIN_P);
+	}
+}
+
 struct socket_server * 
 socket_server_create(uint64_t time) {
 	int i;
@@ -384,16 +578,29 @@ socket_server_create(uint64_t time) {
 		skynet_error(NULL, "socket-server: create event pool failed.");
 		return NULL;
 	}
+#ifdef __linux__
+	fd[0] = fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd[0] < 0) {
+		sp_release(efd);
+		skynet_error(NULL, "socket-server: create eventfd failed.");
+		return NULL;
+	}
+#else
 	if (pipe(fd)) {
 		sp_release(efd);
 		skynet_error(NULL, "socket-server: create socket pair failed.");
 		return NULL;
 	}
+	// ֻܵһδĻѣֻԷһ
+	sp_nonblocking(fd[0]);
+	sp_nonblocking(fd[1]);
+#endif
 	if (sp_add(efd, fd[0], NULL)) {
 		// add recvctrl_fd to event poll
 		skynet_error(NULL, "socket-server: can't add server fd to event pool.");
 		close(fd[0]);
-		close(fd[1]);
+		if (fd[1] != fd[0])
+			close(fd[1]);
 		sp_release(efd);
 		return NULL;
 	}
@@ -404,6 +611,18 @@ socket_server_create(uint64_t time) {
 	ss->recvctrl_fd = fd[0];
 	ss->sendctrl_fd = fd[1];
 	ss->checkctrl = 1;
+	ATOM_INIT(&ss->ctrl_signal, 0);
+	ATOM_INIT(&ss->ctrl_overflowing, 0);
+	ATOM_INIT(&ss->ctrl_tail, 0);
+	ss->ctrl_head = 0;
+	spinlock_init(&ss->ctrl_lock);
+	ss->overflow_head = NULL;
+	ss->overflow_tail = NULL;
+	for (i=0;i<CTRL_RING_SIZE;i++) {
+		ATOM_INIT(&ss->ctrl[i].seq, i);
+	}
+	memset(ss->recvpool, 0, sizeof(ss->recvpool));
+	memset(&ss->recvstat, 0, sizeof(ss->recvstat));
 
 	for (i=0;i<MAX_SOCKET;i++) {
 		struct socket *s = &ss->slot[i];
@@ -413,15 +632,50 @@ socket_server_create(uint64_t time) {
 		spinlock_init(&s->dw_lock);
 	}
 	ATOM_INIT(&ss->alloc_id , 0);
+	ss->id_base = 0;
+	ss->id_mask = 0x7fffffff;
+	ss->group = NULL;
+	ss->group_n = 1;
+	ss->accept_next = 0;
 	ss->event_n = 0;
 	ss->event_index = 0;
 	memset(&ss->soi, 0, sizeof(ss->soi));
-	FD_ZERO(&ss->rfds);
-	assert(ss->recvctrl_fd < FD_SETSIZE);
 
 	return ss;
 }
 
+static int
+shard_bits(int n) {
+	int bits = 0;
+	while ((1 << bits) < n)
+		++bits;
+	return bits;
+}
+
+void
+socket_server_group(struct socket_server **group, int n) {
+	int bits = shard_bits(n);
+	int i;
+	for (i=0;i<n;i++) {
+		struct socket_server *ss = group[i];
+		ss->id_mask = 0x7fffffff >> bits;
+		ss->id_base = bits ? i << (31 - bits) : 0;
+		ss->group = group;
+		ss->group_n = n;
+		ss->accept_next = i;
+	}
+}
+
+int
+socket_server_shard(int id, int n) {
+	int bits = shard_bits(n);
+	if (bits == 0)
+		return 0;
+	int shard = (unsigned)id >> (31 - bits);
+	// not an id of the group (-1 for example), any socket_server will report it invalid
+	return shard < n ? shard : 0;
+}
+
 void
 socket_server_updatetime(struct socket_server *ss, uint64_t time) {
 	ss->time = time;
@@ -521,8 +775,21 @@ socket_server_release(struct socket_server *ss) {
 		}
 		spinlock_destroy(&s->dw_lock);
 	}
-	close(ss->sendctrl_fd);
+	if (ss->sendctrl_fd != ss->recvctrl_fd)
+		close(ss->sendctrl_fd);
 	close(ss->recvctrl_fd);
+	struct ctrl_overflow *o = ss->overflow_head;
+	while (o) {
+		struct ctrl_overflow *next = o->next;
+		FREE(o);
+		o = next;
+	}
+	spinlock_destroy(&ss->ctrl_lock);
+	for (i=0;i<RECVPOOL_CLASS;i++) {
+		recvpool_release(ss->recvpool[i].free);
+		ss->recvpool[i].free = NULL;
+		recvpool_release(recvpool_take(i));
+	}
 	sp_release(ss->event_fd);
 	FREE(ss);
 }
@@ -592,6 +859,7 @@ stat_read(struct socket_server *ss, struct socket *s, int n) {
 static inline void
 stat_write(struct socket_server *ss, struct socket *s, int n) {
 	s->stat.write += n;
+	s->stat.wcount++;
 	s->stat.wtime = ss->time;
 }
 
@@ -675,13 +943,48 @@ _failed_getaddrinfo:
 	return SOCKET_ERR;
 }
 
-//Ϣ(ն)
+// ѶİηŽ iov iov 
 static int
-send_list_tcp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_lock *l, struct socket_message *result) {
+gather_list(struct wb_list *list, struct iovec *iov, int n, size_t *sz) {
+	struct write_buffer *tmp;
+	for (tmp = list->head; tmp && n < MAX_IOV; tmp = tmp->next) {
+		iov[n].iov_base = tmp->ptr;
+		iov[n].iov_len = tmp->sz;
+		*sz += tmp->sz;
+		++n;
+	}
+	return n;
+}
+
+// ӶͷȥѾ sz ֽڣزеʣֽ
+static size_t
+consume_list(struct socket_server *ss, struct wb_list *list, size_t sz) {
 	while (list->head) {
 		struct write_buffer * tmp = list->head;
+		if (sz < tmp->sz) {
+			tmp->ptr += sz;
+			tmp->sz -= sz;
+			return 0;
+		}
+		sz -= tmp->sz;
+		list->head = tmp->next;
+		write_buffer_free(ss,tmp);
+	}
+	list->tail = NULL;
+	return sz;
+}
+
+//Ϣ(ն)ߵа˳ϲһ writev
+static int
+send_list_tcp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
+	struct iovec iov[MAX_IOV];
+	while (s->high.head || s->low.head) {
+		size_t total = 0;
+		int n = gather_list(&s->high, iov, 0, &total);
+		n = gather_list(&s->low, iov, n, &total);
+		ssize_t sz;
 		for (;;) {
-			ssize_t sz = write(s->fd, tmp->ptr, tmp->sz);
+			sz = writev(s->fd, iov, n);
 			if (sz < 0) {
 				switch(errno) {
 				case EINTR:
@@ -692,19 +995,16 @@ send_list_tcp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 				force_close(ss,s,l,result);
 				return SOCKET_CLOSE;
 			}
-			stat_write(ss,s,(int)sz);
-			s->wb_size -= sz;
-			if (sz != tmp->sz) {
-				tmp->ptr += sz;
-				tmp->sz -= sz;
-				return -1;
-			}
 			break;
 		}
-		list->head = tmp->next;
-		write_buffer_free(ss,tmp);
+		stat_write(ss,s,(int)sz);
+		s->wb_size -= sz;
+		// ûдİڵͼ send_buffer_ Ƶ߼
+		consume_list(ss, &s->low, consume_list(ss, &s->high, sz));
+		if ((size_t)sz != total) {
+			return -1;
+		}
 	}
-	list->tail = NULL;
 
 	return -1;
 }
@@ -774,15 +1074,6 @@ send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 	return -1;
 }
 
-static int
-send_list(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_lock *l, struct socket_message *result) {
-	if (s->protocol == PROTOCOL_TCP) {
-		return send_list_tcp(ss, s, list, l, result);
-	} else {
-		return send_list_udp(ss, s, list, result);
-	}
-}
-
 static inline int
 list_uncomplete(struct wb_list *s) {
 	struct write_buffer *wb = s->head;
@@ -818,7 +1109,7 @@ send_buffer_empty(struct socket *s) {
 	Each socket has two write buffer list, high priority and low priority.
 
 	1. send high list as far as possible.
-	2. If high list is empty, try to send low list.
+	2. If high list is empty, try to send low list. (tcp gathers both lists into one writev, high first)
 	3. If low list head is uncomplete (send a part before), move the head of low list to empty high list (call raise_uncomplete) .
 	4. If two lists are both empty, turn off the event. (call check_close)
  */
@@ -826,14 +1117,18 @@ static int
 send_buffer_(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
 	assert(!list_uncomplete(&s->low)); //ͼв룬ʱǰһû꣬˵
 	// step 1
-	if (send_list(ss,s,&s->high,l,result) == SOCKET_CLOSE) { //ȴ߼
-		return SOCKET_CLOSE;
+	if (s->protocol == PROTOCOL_TCP) {
+		if (send_list_tcp(ss,s,l,result) == SOCKET_CLOSE) { //߼ǰͼںһ
+			return SOCKET_CLOSE;
+		}
+	} else {
+		send_list_udp(ss,s,&s->high,result); //ȴ߼
 	}
 	if (s->high.head == NULL) { //߼п
 		// step 2
 		if (s->low.head != NULL) { //ͼа
-			if (send_list(ss,s,&s->low,l,result) == SOCKET_CLOSE) {
-				return SOCKET_CLOSE;
+			if (s->protocol != PROTOCOL_TCP) {
+				send_list_udp(ss,s,&s->low,result);
 			}
 			// step 3
 			if (list_uncomplete(&s->low)) { //û
@@ -1116,6 +1411,17 @@ bind_socket(struct socket_server *ss, struct request_bind *request, struct socke
 	return SOCKET_OPEN;
 }
 
+//  send_request 'H'socket һ socket ߳ accept 
+static void
+handover_socket(struct socket_server *ss, struct request_bind *request) {
+	struct socket *s = new_fd(ss, request->id, request->fd, PROTOCOL_TCP, request->opaque, false);
+	if (s == NULL) {
+		close(request->fd);
+		return;
+	}
+	ATOM_STORE(&s->type , SOCKET_TYPE_PACCEPT);
+}
+
 //  send_request 'S'
 static int
 resume_socket(struct socket_server *ss, struct request_resumepause *request, struct socket_message *result) {
@@ -1180,34 +1486,64 @@ setopt_socket(struct socket_server *ss, struct request_setopt *request) {
 }
 
 // ӹܵжȡϢֽ
-static void
-block_readpipe(int pipefd, void *buffer, int sz) {
+// ȡһ󣬷ͣпʱ 0
+static int
+ctrl_pop(struct socket_server *ss, uint8_t buffer[256]) {
+	struct ctrl_overflow *o;
 	for (;;) {
-		int n = read(pipefd, buffer, sz);
-		if (n<0) {
-			if (errno == EINTR)
-				continue;
-			skynet_error(NULL, "socket-server : read pipe error %s.",strerror(errno));
-			return;
+		struct ctrl_slot *slot = &ss->ctrl[ss->ctrl_head & (CTRL_RING_SIZE-1)];
+		if (ATOM_LOAD(&slot->seq) == ss->ctrl_head + 1) {
+			int type = slot->type;
+			memcpy(buffer, slot->buffer, slot->len);
+			// λûߣһȦд
+			ATOM_STORE(&slot->seq, ss->ctrl_head + CTRL_RING_SIZE);
+			++ss->ctrl_head;
+			return type;
 		}
-		// must atomic read from a pipe
-		assert(n == sz);
-		return;
+		// λѾռ˵ûд꣬ ring ͬһ̸߳
+		// ʱȡ overflow дٻ
+		if (ss->ctrl_head != ATOM_LOAD(&ss->ctrl_tail))
+			return 0;
+		// ring ˣٿ overflow 
+		if (!ATOM_LOAD(&ss->ctrl_overflowing))
+			return 0;
+		spinlock_lock(&ss->ctrl_lock);
+		// Ժȷһ ring ǿյģڸշŽ ring 
+		if (ss->ctrl_head != ATOM_LOAD(&ss->ctrl_tail)) {
+			spinlock_unlock(&ss->ctrl_lock);
+			continue;
+		}
+		o = ss->overflow_head;
+		if (o == NULL) {
+			spinlock_unlock(&ss->ctrl_lock);
+			return 0;
+		}
+		break;
+	}
+	ss->overflow_head = o->next;
+	if (ss->overflow_head == NULL) {
+		ss->overflow_tail = NULL;
+		ATOM_STORE(&ss->ctrl_overflowing, 0);
 	}
+	spinlock_unlock(&ss->ctrl_lock);
+	int type = o->type;
+	memcpy(buffer, o->buffer, o->len);
+	FREE(o);
+	return type;
 }
 
-static int
-has_cmd(struct socket_server *ss) {
-	struct timeval tv = {0,0};
-	int retval;
-
-	FD_SET(ss->recvctrl_fd, &ss->rfds);
-
-	retval = select(ss->recvctrl_fd+1, &ss->rfds, NULL, NULL, &tv);
-	if (retval == 1) {
-		return 1;
+//  recvctrl_fd ϵĻѣڶ
+static void
+ctrl_clear(struct socket_server *ss) {
+	uint8_t tmp[64];
+	for (;;) {
+		ssize_t n = read(ss->recvctrl_fd, tmp, sizeof(tmp));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n == sizeof(tmp) && ss->recvctrl_fd != ss->sendctrl_fd)
+			continue;
+		return;
 	}
-	return 0;
 }
 
 static void
@@ -1292,16 +1628,8 @@ dec_sending_ref(struct socket_server *ss, int id) {
 
 // return type
 static int
-ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
-	int fd = ss->recvctrl_fd; // ͹ܵϢļ
-	// the length of message is one byte, so 256+8 buffer size is enough.
-	uint8_t buffer[256];
-	uint8_t header[2];
-	block_readpipe(fd, header, sizeof(header));
-	int type = header[0];
-	int len = header[1];
-	block_readpipe(fd, buffer, len);
-	// ctrl command only exist in local fd, so don't worry about endian.
+ctrl_cmd(struct socket_server *ss, int type, uint8_t *buffer, struct socket_message *result) {
+	// ctrl command only exist in local process, so don't worry about endian.
 	switch (type) {
 	case 'R':
 		return resume_socket(ss,(struct request_resumepause *)buffer, result);
@@ -1311,6 +1639,9 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 		return bind_socket(ss,(struct request_bind *)buffer, result);
 	case 'L':
 		return listen_socket(ss,(struct request_listen *)buffer, result);
+	case 'H':
+		handover_socket(ss,(struct request_bind *)buffer);
+		return -1;
 	case 'K':
 		return close_socket(ss,(struct request_close *)buffer, result);
 	case 'O':
@@ -1355,10 +1686,10 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 static int
 forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
 	int sz = s->p.size;
-	char * buffer = MALLOC(sz);
+	char * buffer = recvpool_alloc(ss, sz);
 	int n = (int)read(s->fd, buffer, sz);
 	if (n<0) {
-		FREE(buffer);
+		recvpool_free(ss, buffer, sz);
 		switch(errno) {
 		case EINTR:
 			break;
@@ -1374,7 +1705,7 @@ forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_lo
 		return -1;
 	}
 	if (n==0) {
-		FREE(buffer);
+		recvpool_free(ss, buffer, sz);
 		if (nomore_sending_data(s)) {
 			force_close(ss,s,l,result); 
 			return SOCKET_CLOSE;
@@ -1387,7 +1718,7 @@ forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_lo
 
 	if (ATOM_LOAD(&s->type) == SOCKET_TYPE_HALFCLOSE) {
 		// discard recv data
-		FREE(buffer);
+		recvpool_free(ss, buffer, sz);
 		return -1;
 	}
 
@@ -1399,6 +1730,16 @@ forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_lo
 		s->p.size /= 2;
 	}
 
+	int size = recvpool_size(n);
+	if (size < sz && size <= (MIN_READ_BUFFER << (RECVPOOL_CLASS-1))) {
+		// ݲһ룬ƵʴСĻȥڳ
+		char * tmp = recvpool_alloc(ss, size);
+		memcpy(tmp, buffer, n);
+		recvpool_free(ss, buffer, sz);
+		buffer = tmp;
+		++ss->recvstat.copy;
+	}
+
 	result->opaque = s->opaque;
 	result->id = s->id;
 	result->ud = n;
@@ -1518,6 +1859,8 @@ getname(union sockaddr_all *u, char *buffer, size_t sz) {
 	}
 }
 
+static void send_request(struct socket_server *ss, struct request_package *request, char type, int len);
+
 // return 0 when failed, or -1 when file limit
 static int
 report_accept(struct socket_server *ss, struct socket *s, struct socket_message *result) {
@@ -1535,22 +1878,37 @@ report_accept(struct socket_server *ss, struct socket *s, struct socket_message
 			return 0;
 		}
 	}
-	int id = reserve_id(ss);
+	struct socket_server *owner = ss;
+	if (ss->group_n > 1) {
+		// spread the connections over all the socket threads
+		owner = ss->group[ss->accept_next++ % ss->group_n];
+	}
+	int id = reserve_id(owner);
 	if (id < 0) {
 		close(client_fd);
 		return 0;
 	}
 	socket_keepalive(client_fd);
 	sp_nonblocking(client_fd);
-	struct socket *ns = new_fd(ss, id, client_fd, PROTOCOL_TCP, s->opaque, false);
-	if (ns == NULL) {
-		close(client_fd);
-		return 0;
+	if (owner == ss) {
+		struct socket *ns = new_fd(ss, id, client_fd, PROTOCOL_TCP, s->opaque, false);
+		if (ns == NULL) {
+			close(client_fd);
+			return 0;
+		}
+		ATOM_STORE(&ns->type , SOCKET_TYPE_PACCEPT);
+	} else {
+		// the owner adds it to its poll set. The request is queued before the service knows the id,
+		// so it's handled before any request of the service about this socket.
+		struct request_package request;
+		request.u.bind.id = id;
+		request.u.bind.fd = client_fd;
+		request.u.bind.opaque = s->opaque;
+		send_request(owner, &request, 'H', sizeof(request.u.bind));
 	}
 	// accept new one connection
 	stat_read(ss,s,1);
 
-	ATOM_STORE(&ns->type , SOCKET_TYPE_PACCEPT);
 	result->opaque = s->opaque;
 	result->id = s->id;
 	result->ud = id;
@@ -1585,14 +1943,20 @@ clear_closed_event(struct socket_server *ss, struct socket_message * result, int
 int 
 socket_server_poll(struct socket_server *ss, struct socket_message * result, int * more) {
 	for (;;) {
-		if (ss->checkctrl) { // ܵǷϢ
-			if (has_cmd(ss)) {
-				int type = ctrl_cmd(ss, result); // worker ߳ send_request İý͵ǰ socket ״̬
+		if (ss->checkctrl) { // ǷϢһ sp_wait ֮ȡ
+			uint8_t buffer[256];
+			int type = ctrl_pop(ss, buffer);
+			if (type) {
+				type = ctrl_cmd(ss, type, buffer, result); // worker ߳ send_request İý͵ǰ socket ״̬
 				if (type != -1) {
 					clear_closed_event(ss, result, type);
 					return type;
 				} else
 					continue;
+			} else if (ATOM_LOAD(&ss->ctrl_signal)) {
+				// ٻѣȻټһζУշŽҪȵһ¼
+				ATOM_STORE(&ss->ctrl_signal, 0);
+				continue;
 			} else {
 				ss->checkctrl = 0; //û
 			}
@@ -1615,7 +1979,9 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 		struct event *e = &ss->ev[ss->event_index++]; // epoll 
 		struct socket *s = e->s;
 		if (s == NULL) {
-			// dispatch pipe message at beginning
+			// recvctrl_fd ɶڿͷѾһִ
+			ctrl_clear(ss);
+			ss->checkctrl = 1;
 			continue;
 		}
 		struct socket_lock l;
@@ -1690,21 +2056,71 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 	}
 }
 
-//дܵ socket ̶߳
+// Ž ring˷ 0
+static int
+ctrl_push(struct socket_server *ss, struct request_package *request, char type, int len) {
+	if (ATOM_LOAD(&ss->ctrl_overflowing))
+		return 0;
+	unsigned long pos = ATOM_LOAD(&ss->ctrl_tail);
+	struct ctrl_slot *slot;
+	for (;;) {
+		slot = &ss->ctrl[pos & (CTRL_RING_SIZE-1)];
+		long diff = (long)(ATOM_LOAD(&slot->seq) - pos);
+		if (diff == 0) {
+			if (ATOM_CAS(&ss->ctrl_tail, pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			// socket ̻߳ûȡһȦ
+			return 0;
+		}
+		pos = ATOM_LOAD(&ss->ctrl_tail);
+	}
+	slot->type = (uint8_t)type;
+	slot->len = (uint8_t)len;
+	memcpy(slot->buffer, request->u.buffer, len);
+	ATOM_STORE(&slot->seq, pos + 1);
+	return 1;
+}
+
+static void
+ctrl_overflow(struct socket_server *ss, struct request_package *request, char type, int len) {
+	struct ctrl_overflow *o = MALLOC(sizeof(*o) + len);
+	o->next = NULL;
+	o->type = (uint8_t)type;
+	o->len = (uint8_t)len;
+	memcpy(o->buffer, request->u.buffer, len);
+	spinlock_lock(&ss->ctrl_lock);
+	if (ss->overflow_tail) {
+		ss->overflow_tail->next = o;
+	} else {
+		ss->overflow_head = o;
+	}
+	ss->overflow_tail = o;
+	ATOM_STORE(&ss->ctrl_overflowing, 1);
+	spinlock_unlock(&ss->ctrl_lock);
+}
+
+//ŽУ socket ߳ȡsocket ߳ڴʱϵͳ
 static void
 send_request(struct socket_server *ss, struct request_package *request, char type, int len) {
-	request->header[6] = (uint8_t)type;
-	request->header[7] = (uint8_t)len; //  ctrl_cmd ȶ
-	for (;;) {
-		ssize_t n = write(ss->sendctrl_fd, &request->header[6], len+2); // д뷢͹ܵϢļ
-		if (n<0) {
-			if (errno != EINTR) {
-				skynet_error(NULL, "socket-server : send ctrl command error %s.", strerror(errno));
+	assert(len < 256);
+	if (!ctrl_push(ss, request, type, len)) {
+		ctrl_overflow(ss, request, type, len);
+	}
+	int signal = 0;
+	if (ATOM_LOAD(&ss->ctrl_signal) == 0 && ATOM_CAS(&ss->ctrl_signal, signal, 1)) {
+		uint64_t one = 1;	// eventfd ֻ 8 ֽڵд
+		for (;;) {
+			ssize_t n = write(ss->sendctrl_fd, &one, sizeof(one));
+			if (n<0) {
+				if (errno == EINTR)
+					continue;
+				if (errno != EAGAIN) {
+					skynet_error(NULL, "socket-server : send ctrl signal error %s.", strerror(errno));
+				}
 			}
-			continue;
+			return;
 		}
-		assert(n == len+2);
-		return;
 	}
 }
 
@@ -2229,6 +2645,7 @@ query_info(struct socket *s, struct socket_info *si) {
 	si->opaque = (uint64_t)s->opaque;
 	si->read = s->stat.read;
 	si->write = s->stat.write;
+	si->wcount = s->stat.wcount;
 	si->rtime = s->stat.rtime;
 	si->wtime = s->stat.wtime;
 	si->wbuffer = s->wb_size;
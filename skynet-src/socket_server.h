@@ -24,6 +24,11 @@ struct socket_message {
 };
 
 struct socket_server * socket_server_create(uint64_t time);
+// One socket_server per socket thread : the id of a socket tells which socket_server owns it,
+// and the connections accepted by a listen socket are spread over the group.
+// Call it before any socket is opened.
+void socket_server_group(struct socket_server **group, int n);
+int socket_server_shard(int id, int n);
 void socket_server_release(struct socket_server *);
 void socket_server_updatetime(struct socket_server *, uint64_t time);
 int socket_server_poll(struct socket_server *, struct socket_message *result, int *more);
@@ -70,4 +75,9 @@ void socket_server_userobject(struct socket_server *, struct socket_object_inter
 
 struct socket_info * socket_server_info(struct socket_server *);
 
+// The buffer of SOCKET_DATA comes from a pool of the socket threads, give it back with its data size.
+// Calling skynet_free on it is still fine, it just doesn't go back to the pool.
+void socket_server_recycle(void *buffer, int sz);
+void socket_server_recvpool(struct socket_server *, struct socket_recvpool_stat *stat);
+
 #endif
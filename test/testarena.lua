@@ -0,0 +1,119 @@
+-- Arena allocator : run the same churn of small tables, strings and closures in a service on the default allocator
+-- and in one launched with "-arena" ( skynet.newservice("-arena", name, ...) ).
+-- Both must compute the same results, and the chunks of an arena service must be released when it's killed.
+local skynet = require "skynet"
+require "skynet.manager"	-- skynet.kill
+
+local mode = ...
+
+if mode == "worker" then
+
+local function churn(n)
+	local t = {}
+	for i = 1, n do
+		local k = i % 1000
+		t[k] = { id = i, name = "obj" .. i, f = function() return i end }
+		if i % 7 == 0 then
+			t[k].list = { i, i + 1, i + 2 }
+		end
+	end
+	return t
+end
+
+local function checksum(t)
+	local sum = 0
+	for k, v in pairs(t) do
+		sum = sum + k + v.id + #v.name + v.f()
+		if v.list then
+			sum = sum + v.list[1] + v.list[2] + v.list[3]
+		end
+	end
+	return sum
+end
+
+local hold
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd, n)
+		if cmd == "check" then
+			skynet.ret(skynet.pack(checksum(churn(n))))
+		elseif cmd == "hold" then
+			-- n small objects live until the service is killed
+			hold = {}
+			for i = 1, n do
+				hold[i] = { i, "obj" .. i }
+			end
+			skynet.ret(skynet.pack(collectgarbage "count"))
+		elseif cmd == "churn" then
+			collectgarbage "collect"
+			local start = skynet.hpc()
+			for i = 1, 10 do
+				churn(n)
+			end
+			collectgarbage "collect"
+			skynet.ret(skynet.pack(skynet.hpc() - start, collectgarbage "count"))
+		end
+	end)
+end)
+
+else
+
+local N = 100000
+local HOLD = 50000
+local KILL = 20
+
+local function rss()
+	local f = io.open "/proc/self/statm"
+	if f then
+		local pages = f:read "n"
+		pages = f:read "n"
+		f:close()
+		return pages * 4	-- in K, assume 4K pages
+	end
+end
+
+local function bench(...)
+	local addr = skynet.newservice(...)
+	local best = math.huge
+	local mem
+	for i = 1, 5 do
+		local ti
+		ti, mem = skynet.call(addr, "lua", "churn", N)
+		best = math.min(best, ti)
+	end
+	skynet.kill(addr)
+	return best, mem
+end
+
+skynet.start(function()
+	local default = skynet.newservice(SERVICE_NAME, "worker")
+	local arena = skynet.newservice("-arena", SERVICE_NAME, "worker")
+	for _, n in ipairs { 1, 1000, N } do
+		assert(skynet.call(default, "lua", "check", n) == skynet.call(arena, "lua", "check", n), "arena computes a different result")
+	end
+	skynet.kill(default)
+	skynet.kill(arena)
+
+	-- launch and kill arena services that hold several MB each, the rss must not grow by all of them
+	local r0 = rss()
+	local held = 0
+	for i = 1, KILL do
+		local addr = skynet.newservice("-arena", SERVICE_NAME, "worker")
+		held = held + skynet.call(addr, "lua", "hold", HOLD)
+		skynet.kill(addr)
+	end
+	if r0 then
+		local grow = rss() - r0
+		skynet.error(string.format("killed %d arena services holding %.0fK, rss grows %dK", KILL, held, grow))
+		assert(grow < held / 2, "the arena is not released after skynet.kill")
+	end
+
+	for _, args in ipairs { { SERVICE_NAME, "worker" }, { "-arena", SERVICE_NAME, "worker" } } do
+		local churn, mem = bench(table.unpack(args))
+		skynet.error(string.format("%-8s churn %d objects x 10 : %.2fms (%.0fK after gc)",
+			args[1] == "-arena" and "arena" or "default", N, churn / 1e6, mem))
+	end
+	skynet.exit()
+end)
+
+end
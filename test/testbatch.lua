@@ -0,0 +1,68 @@
+-- Fan-out : broadcast to N services with a loop of skynet.send, and with skynet.sendbatch (one pack, shared payload).
+local skynet = require "skynet"
+
+local mode = ...
+
+if mode == "member" then
+
+local count = 0
+local expect
+local waiting
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd, n)
+		if cmd == "broadcast" then
+			count = count + 1
+			if count == expect then
+				skynet.wakeup(waiting)
+			end
+		else
+			assert(cmd == "wait")
+			expect = n
+			waiting = coroutine.running()
+			if count < expect then
+				skynet.wait(waiting)
+			end
+			count = 0
+			skynet.ret()
+		end
+	end)
+end)
+
+else
+
+local MEMBER = 100
+local ROUND = 1000
+local payload = { room = 1, event = "move", x = 1.5, y = 2.5, name = string.rep("x", 64) }
+
+local function bench(name, members, send)
+	local start = skynet.hpc()
+	for i = 1, ROUND do
+		send(members)
+	end
+	local sent = skynet.hpc()
+	for _, addr in ipairs(members) do
+		skynet.call(addr, "lua", "wait", ROUND)
+	end
+	local done = skynet.hpc()
+	skynet.error(string.format("%-10s %d members x %d rounds : send %.3fs total %.3fs %.0f msg/s", name, #members, ROUND,
+		(sent - start) / 1e9, (done - start) / 1e9, #members * ROUND / ((done - start) / 1e9)))
+end
+
+skynet.start(function()
+	local members = {}
+	for i = 1, MEMBER do
+		members[i] = skynet.newservice(SERVICE_NAME, "member")
+	end
+	bench("send loop", members, function(members)
+		for _, addr in ipairs(members) do
+			skynet.send(addr, "lua", "broadcast", payload)
+		end
+	end)
+	bench("sendbatch", members, function(members)
+		skynet.sendbatch(members, "lua", "broadcast", payload)
+	end)
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,55 @@
+-- Cancel timers : skynet.timeout returns a timer id, skynet.canceltimeout removes it from the timer wheel.
+local skynet = require "skynet"
+
+local function test_cancel()
+	local fired = {}
+	local ids = {}
+	for i = 1, 100 do
+		ids[i] = skynet.timeout(i % 10 + 1, function() fired[i] = true end)
+	end
+	for i = 1, 100, 2 do
+		assert(skynet.canceltimeout(ids[i]))
+	end
+	-- timeout 0 is pushed into the message queue at once, cancel it before it's dispatched
+	local zero = false
+	assert(skynet.canceltimeout(skynet.timeout(0, function() zero = true end)))
+	skynet.sleep(20)
+	for i = 1, 100 do
+		assert((fired[i] == true) == (i % 2 == 0), i)
+	end
+	assert(not zero)
+	-- fired timer can't be cancelled
+	assert(not skynet.canceltimeout(ids[2]))
+	skynet.error "cancel timer OK"
+end
+
+local function test_wakeup()
+	-- skynet.wakeup breaks a sleep and cancels its timer
+	local co = coroutine.running()
+	skynet.fork(function()
+		skynet.wakeup(co)
+	end)
+	assert(skynet.sleep(1000) == "BREAK")
+	assert(skynet.task() == 0, "sleep timer is not cancelled")
+	skynet.error "wakeup cancel OK"
+end
+
+local function bench(n)
+	local function f() end
+	local start = skynet.hpc()
+	for i = 1, n do
+		skynet.canceltimeout(skynet.timeout(500, f))
+	end
+	local t = (skynet.hpc() - start) / 1e9
+	skynet.error(string.format("timeout+cancel %d deadlines : %.3fs %.0f per second", n, t, n / t))
+end
+
+skynet.start(function()
+	test_cancel()
+	test_wakeup()
+	bench(200000)
+	skynet.trace_timeout(true)
+	test_cancel()
+	skynet.trace_timeout(false)
+	skynet.exit()
+end)
@@ -0,0 +1,75 @@
+-- C memory accounting (only with jemalloc, the malloc hook) : each member holds BLOCK buffers of SIZE from skynet.pack,
+-- then frees half, check memory.info() and memory.peak() of it, then time skynet.pack/trash in all members at once.
+local skynet = require "skynet"
+require "skynet.manager"	-- skynet.kill
+local memory = require "skynet.memory"
+
+local mode = ...
+
+local SIZE = 64 * 1024
+local BLOCK = 64
+local MEMBER = 8
+local ROUND = 200000
+
+if mode == "member" then
+
+local hold = {}
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd)
+		if cmd == "hold" then
+			local str = string.rep("x", SIZE)
+			for i = 1, BLOCK do
+				hold[i] = table.pack(skynet.pack(str))
+			end
+			local current = memory.current()
+			for i = 1, BLOCK // 2 do
+				skynet.trash(hold[i][1], hold[i][2])
+				hold[i] = nil
+			end
+			skynet.ret(skynet.pack(current, memory.current()))
+		elseif cmd == "churn" then
+			local start = skynet.hpc()
+			for i = 1, ROUND do
+				skynet.trash(skynet.pack(i, "hello"))
+			end
+			skynet.ret(skynet.pack(skynet.hpc() - start))
+		end
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local members = {}
+	for i = 1, MEMBER do
+		members[i] = skynet.newservice(SERVICE_NAME, "member")
+	end
+	local addr = members[1]
+	local full, half = skynet.call(addr, "lua", "hold")
+	local info = memory.info()[addr] or 0
+	local peak = memory.peak()[addr] or 0
+	skynet.error(string.format("hold %dK, free half %dK, info %dK, peak %dK", full // 1024, half // 1024, info // 1024, peak // 1024))
+	if full > 0 then
+		assert(full >= SIZE * BLOCK and half >= SIZE * BLOCK // 2 and half < full)
+		assert(math.abs(info - half) < full // 4)
+		assert(peak >= full - full // 8)
+	else
+		skynet.error "No malloc hook"
+	end
+
+	local reqs = skynet.request()
+	for _, addr in ipairs(members) do
+		reqs:add { addr, "lua", "churn" }
+	end
+	local start = skynet.hpc()
+	for _ in reqs:select() do end
+	local ti = skynet.hpc() - start
+	skynet.error(string.format("%d members pack/trash %d times : %.2fms, %.0fns per pair", MEMBER, ROUND, ti / 1e6, ti / (MEMBER * ROUND)))
+	for _, addr in ipairs(members) do
+		skynet.kill(addr)
+	end
+	skynet.exit()
+end)
+
+end
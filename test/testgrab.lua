@@ -0,0 +1,70 @@
+-- Handle lookup on the send path : every skynet.send grabs the destination context by handle.
+-- 1..16 sender services send to a shared set of receivers at the same time, run it with different `thread` settings.
+local skynet = require "skynet"
+
+local mode = ...
+
+if mode == "receiver" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd)
+		if cmd == "sync" then
+			skynet.ret()
+		end
+	end)
+end)
+
+elseif mode == "sender" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, receivers, n)
+		local m = #receivers
+		for i = 1, n do
+			-- empty message, the cost is mostly grab and queue push
+			skynet.rawsend(receivers[i % m + 1], "lua", "")
+		end
+		skynet.ret()
+	end)
+end)
+
+else
+
+local RECEIVER = 64
+local N = 400000
+
+skynet.start(function()
+	local receivers = {}
+	for i = 1, RECEIVER do
+		receivers[i] = skynet.newservice(SERVICE_NAME, "receiver")
+	end
+	local senders = {}
+	for i = 1, 16 do
+		senders[i] = skynet.newservice(SERVICE_NAME, "sender")
+	end
+	local n = 1
+	while n <= 16 do
+		local per = N // n
+		local start = skynet.hpc()
+		local co = coroutine.running()
+		local done = 0
+		for i = 1, n do
+			skynet.fork(function()
+				skynet.call(senders[i], "lua", receivers, per)
+				done = done + 1
+				if done == n then
+					skynet.wakeup(co)
+				end
+			end)
+		end
+		skynet.wait(co)
+		local ti = (skynet.hpc() - start) / 1e9
+		skynet.error(string.format("senders = %2d sends = %d time = %.3fs %.0f send/s", n, per * n, ti, per * n / ti))
+		for _, r in ipairs(receivers) do
+			skynet.call(r, "lua", "sync")	-- drain
+		end
+		n = n * 2
+	end
+	skynet.exit()
+end)
+
+end
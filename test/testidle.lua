@@ -0,0 +1,112 @@
+-- Idle-to-busy latency : send a message to an idle service while the sender keeps its worker busy,
+-- and the cpu time the whole process burns while every service is idle.
+-- Burst : BURST services wake up at the same timer tick while all the workers sleep, each one is busy for 20ms.
+-- The timer thread wakes one worker and the woken workers pass it on, so several services must start
+-- at once, not one more each time a worker finishes its 20ms.
+local skynet = require "skynet"
+
+local mode = ...
+
+if mode == "receiver" then
+
+local delay = {}
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd, stamp)
+		if cmd == "stamp" then
+			delay[#delay+1] = skynet.hpc() - stamp
+		else
+			assert(cmd == "result")
+			skynet.ret(skynet.pack(delay))
+			delay = {}
+		end
+	end)
+end)
+
+elseif mode == "burst" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, deadline)
+		skynet.sleep(deadline - skynet.now())
+		local start = skynet.hpc()
+		local t = start + 20000000	-- 20ms
+		while skynet.hpc() < t do end
+		skynet.ret(skynet.pack(start))
+	end)
+end)
+
+else
+
+local function busy(ns)
+	local t = skynet.hpc() + ns
+	while skynet.hpc() < t do end
+end
+
+local function cputime()
+	local f = io.open "/proc/self/stat"
+	if not f then
+		return
+	end
+	local stat = f:read "a"
+	f:close()
+	-- utime and stime are the 14th and 15th fields, skip "pid (comm)" first
+	local fields = {}
+	for v in stat:match "%) (.*)":gmatch "%S+" do
+		fields[#fields+1] = v
+	end
+	return (tonumber(fields[12]) + tonumber(fields[13])) * 10	-- in ms, assume 100 ticks per second
+end
+
+skynet.start(function()
+	local receiver = skynet.newservice(SERVICE_NAME, "receiver")
+	local N = 200
+	for i = 1, N do
+		skynet.sleep(2)	-- let all the workers go to sleep
+		skynet.send(receiver, "lua", "stamp", skynet.hpc())
+		busy(5000000)	-- hold this worker for 5ms
+	end
+	local delay = skynet.call(receiver, "lua", "result")
+	table.sort(delay)
+	local function percent(p)
+		return delay[math.max(1, math.floor(#delay * p))] / 1000
+	end
+	skynet.error(string.format("idle to busy latency (us) : p50 = %.1f p90 = %.1f p99 = %.1f max = %.1f",
+		percent(0.5), percent(0.9), percent(0.99), delay[#delay] / 1000))
+
+	local thread = tonumber(skynet.getenv "thread")
+	local BURST = thread * 4
+	local burst = {}
+	for i = 1, BURST do
+		burst[i] = skynet.newservice(SERVICE_NAME, "burst")
+	end
+	local deadline = skynet.now() + 50
+	local start = {}
+	for i = 1, BURST do
+		skynet.fork(function()
+			local t = skynet.call(burst[i], "lua", deadline)
+			start[#start+1] = t
+		end)
+	end
+	while #start < BURST do
+		skynet.sleep(1)
+	end
+	table.sort(start)
+	local n = 0	-- started in the first 10ms
+	for _, t in ipairs(start) do
+		if t - start[1] < 10000000 then
+			n = n + 1
+		end
+	end
+	skynet.error(string.format("burst of %d services on %d workers : %d started in the first 10ms", BURST, thread, n))
+	assert(thread == 1 or n > 1, "the burst is drained by one worker at a time")
+
+	local start = cputime()
+	if start then
+		local sec = 5
+		skynet.sleep(sec * 100)
+		skynet.error(string.format("idle cpu : %.1f ms per second", (cputime() - start) / sec))
+	end
+	skynet.exit()
+end)
+
+end
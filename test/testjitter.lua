@@ -0,0 +1,74 @@
+-- Timer jitter : fire 100k timers with skynet.timeoutms and report how late they are.
+-- The timers are spread over SERVICE services with ROUND_TIMERS in flight per service.
+-- Run it with timer_resolution = 1, 2, 5 and 10 in the config to compare.
+local skynet = require "skynet"
+require "skynet.manager"	-- skynet.kill
+
+local mode = ...
+
+local SERVICE = 50
+local ROUND_TIMERS = 20
+local MAXDELAY = 20	-- ms
+
+if mode == "member" then
+
+local function round(late)
+	local co = coroutine.running()
+	local n = 0
+	for i = 1, ROUND_TIMERS do
+		local ms = math.random(1, MAXDELAY)
+		local expect = skynet.hpc() + ms * 1000000
+		skynet.timeoutms(ms, function()
+			late[#late+1] = skynet.hpc() - expect
+			n = n + 1
+			if n == ROUND_TIMERS then
+				skynet.wakeup(co)
+			end
+		end)
+	end
+	skynet.wait(co)
+end
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, count)
+		local late = {}
+		for i = 1, count // ROUND_TIMERS do
+			round(late)
+		end
+		skynet.retpack(late)
+	end)
+end)
+
+else
+
+local N = 100000
+
+skynet.start(function()
+	local resolution = tonumber(skynet.getenv "timer_resolution") or 10
+	local members = {}
+	for i = 1, SERVICE do
+		members[i] = skynet.newservice(SERVICE_NAME, "member")
+	end
+	local start = skynet.hpc()
+	local late = {}
+	local reqs = skynet.request()
+	for _, addr in ipairs(members) do
+		reqs:add { addr, "lua", N // SERVICE }
+	end
+	for _, resp in reqs:select() do
+		table.move(resp[1], 1, #resp[1], #late + 1, late)
+	end
+	local n = #late
+	table.sort(late)
+	local function percent(p)
+		return late[math.max(1, math.floor(n * p))] / 1000
+	end
+	skynet.error(string.format("resolution %dms, %d timers in %.2fs, lateness (us) : min = %.1f p50 = %.1f p90 = %.1f p99 = %.1f max = %.1f",
+		resolution, n, (skynet.hpc() - start) / 1e9, late[1] / 1000, percent(0.5), percent(0.9), percent(0.99), late[n] / 1000))
+	for _, addr in ipairs(members) do
+		skynet.kill(addr)
+	end
+	skynet.exit()
+end)
+
+end
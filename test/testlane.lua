@@ -0,0 +1,63 @@
+-- Response latency of an overloaded service : the reply of a skynet.call should not wait behind the flood of requests.
+local skynet = require "skynet"
+
+local mode = ...
+
+if mode == "echo" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		skynet.ret()
+	end)
+end)
+
+elseif mode == "worker" then
+
+local work = 0
+local delayed	-- requests dispatched between the call and its reply
+local waiting
+
+skynet.start(function()
+	local echo = skynet.newservice(SERVICE_NAME, "echo")
+	skynet.dispatch("lua", function(_,_, cmd)
+		if cmd == "work" then
+			work = work + 1
+		elseif cmd == "probe" then
+			local before = work
+			local t = skynet.hpc()
+			skynet.call(echo, "lua")
+			delayed = work - before
+			local high = assert(skynet.stat "mqlen_high", "mqlen_high is not exposed")
+			skynet.error(string.format("reply after %.3f ms, %d requests dispatched before it, mqlen = %d high = %d",
+				(skynet.hpc() - t) / 1e6, delayed, skynet.stat "mqlen", high))
+			if waiting then
+				skynet.wakeup(waiting)
+			end
+		else
+			assert(cmd == "count")
+			if not delayed then
+				waiting = coroutine.running()
+				skynet.wait(waiting)
+			end
+			skynet.ret(skynet.pack(work, delayed))
+		end
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local worker = skynet.newservice(SERVICE_NAME, "worker")
+	local N = 100000
+	skynet.send(worker, "lua", "probe")
+	for i = 1, N do
+		skynet.send(worker, "lua", "work")
+	end
+	local work, delayed = skynet.call(worker, "lua", "count")
+	assert(work == N)
+	-- the reply takes the high lane, it must not wait behind the flood
+	assert(delayed < N // 10, "the reply waited behind the requests")
+	skynet.exit()
+end)
+
+end
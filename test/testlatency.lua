@@ -0,0 +1,44 @@
+-- Latency histograms : a burst of messages to a slow service, then read its queue wait and callback time by the debug protocol.
+local skynet = require "skynet"
+require "skynet.manager"	-- skynet.kill
+
+local mode = ...
+
+local N = 50
+local BUSY = 2000000	-- 2ms per message
+
+if mode == "slave" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		local t = skynet.hpc() + BUSY
+		while skynet.hpc() < t do end
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local slave = skynet.newservice(SERVICE_NAME, "slave")
+	for i = 1, N do
+		skynet.send(slave, "lua")
+	end
+	skynet.call(slave, "debug", "PING")
+	local latency = skynet.call(slave, "debug", "LATENCY")
+	for name, item in pairs(latency) do
+		skynet.error(string.format("%-8s count = %d wait (us) avg = %d p50 < %d p99 < %d max < %d , callback (us) avg = %d p50 < %d p99 < %d max < %d",
+			name, item.count, item.wait_avg, item.wait_p50, item.wait_p99, item.wait_max, item.cb_avg, item.cb_p50, item.cb_p99, item.cb_max))
+	end
+	local lua = latency.lua
+	assert(lua.count == N)
+	-- each message is at least 2ms, the last one waits for all the others
+	assert(lua.cb_p50 >= 2048 and lua.cb_avg >= BUSY // 1000)
+	assert(lua.wait_max >= (N - 1) * BUSY // 1000)
+	local stat = skynet.call(slave, "debug", "STAT")
+	skynet.error(string.format("stat : wait_p99 < %dus cb_p99 < %dus", stat.wait_p99, stat.cb_p99))
+	skynet.error "latency OK"
+	skynet.kill(slave)
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,69 @@
+-- Bounded mailbox : flood a blocked service, and check what each policy keeps.
+local skynet = require "skynet"
+require "skynet.manager"
+
+local mode = ...
+
+if mode == "slave" then
+
+local recv = {}
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd, arg)
+		if cmd == "block" then
+			local t = skynet.hpc() + arg * 1000000
+			while skynet.hpc() < t do end	-- hold the worker, let the mailbox fill up
+		elseif cmd == "data" then
+			recv[#recv+1] = arg
+		elseif cmd == "call" then
+			skynet.ret()
+		elseif cmd == "result" then
+			skynet.ret(skynet.pack(recv, skynet.stat "mqdrop"))
+			recv = {}
+		end
+	end)
+end)
+
+else
+
+local LIMIT = 100
+local N = 1000
+
+local function flood(policy, ...)
+	local slave = skynet.newservice(SERVICE_NAME, "slave")
+	skynet.mailbox(slave, LIMIT, policy, ...)
+	skynet.send(slave, "lua", "block", 100)
+	for i = 1, N do
+		skynet.send(slave, "lua", "data", i)
+	end
+	skynet.sleep(20)
+	local recv, drop = skynet.call(slave, "lua", "result")
+	skynet.kill(slave)
+	skynet.error(string.format("%-8s received %d [%s .. %s] dropped %d", policy, #recv, recv[1], recv[#recv], drop))
+	return recv, drop
+end
+
+skynet.start(function()
+	local recv, drop = flood "reject"
+	-- the block message may still be in the mailbox, counted in the limit
+	assert(#recv <= LIMIT and drop >= N - LIMIT and recv[1] == 1)
+	recv, drop = flood "dropold"
+	assert(#recv <= LIMIT and drop >= N - LIMIT and recv[#recv] == N)
+	recv, drop = flood("shed", "text")	-- lua messages are not shed
+	assert(#recv == N and drop == 0)
+	recv, drop = flood("shed", "lua")
+	assert(#recv <= LIMIT and drop >= N - LIMIT)
+
+	-- a rejected call raises an error at the caller
+	local slave = skynet.newservice(SERVICE_NAME, "slave")
+	skynet.mailbox(slave, 1)
+	skynet.send(slave, "lua", "block", 100)
+	skynet.send(slave, "lua", "data", 0)
+	local ok = pcall(skynet.call, slave, "lua", "call")
+	assert(not ok)
+	skynet.error("rejected call raises error")
+	skynet.kill(slave)
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,69 @@
+-- Mailbox throughput: 1..32 producer services flood one consumer.
+-- Run it with different `thread` settings, and build with/without -DUSE_LOCKFREE_MQ to compare.
+local skynet = require "skynet"
+
+local mode, total = ...
+
+if mode == "consumer" then
+
+local count = 0
+local expect
+local waiting
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd, n)
+		if cmd == "data" then
+			count = count + 1
+			if count == expect then
+				skynet.wakeup(waiting)
+			end
+		else
+			assert(cmd == "wait")
+			expect = n
+			waiting = coroutine.running()
+			if count < expect then
+				skynet.wait(waiting)
+			end
+			count = 0
+			skynet.ret()
+		end
+	end)
+end)
+
+elseif mode == "producer" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, consumer, n)
+		for i = 1, n do
+			skynet.send(consumer, "lua", "data")
+		end
+		skynet.ret()
+	end)
+end)
+
+else
+
+local N = tonumber(total) or 1000000
+
+skynet.start(function()
+	local consumer = skynet.newservice(SERVICE_NAME, "consumer")
+	local producer = {}
+	for i = 1, 32 do
+		producer[i] = skynet.newservice(SERVICE_NAME, "producer")
+	end
+	local n = 1
+	while n <= 32 do
+		local per = N // n
+		local start = skynet.hpc()
+		for i = 1, n do
+			skynet.fork(skynet.call, producer[i], "lua", consumer, per)
+		end
+		skynet.call(consumer, "lua", "wait", per * n)
+		local ti = (skynet.hpc() - start) / 1e9
+		skynet.error(string.format("producers = %2d messages = %d time = %.3fs %.0f msg/s", n, per * n, ti, per * n / ti))
+		n = n * 2
+	end
+	skynet.exit()
+end)
+
+end
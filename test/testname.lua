@@ -0,0 +1,75 @@
+-- Local names : register many names for many services, look them up, and retire the services.
+local skynet = require "skynet"
+require "skynet.manager"
+
+local mode = ...
+
+if mode == "room" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		skynet.ret()
+	end)
+end)
+
+else
+
+local ROOM = 200
+local NAME = 50
+
+local function elapsed(start)
+	return (skynet.hpc() - start) / 1e6
+end
+
+skynet.start(function()
+	local rooms = {}
+	for i = 1, ROOM do
+		rooms[i] = skynet.newservice(SERVICE_NAME, "room")
+	end
+
+	local start = skynet.hpc()
+	for i, addr in ipairs(rooms) do
+		for j = 1, NAME do
+			skynet.name(string.format(".room%d_%d", i, j), addr)
+		end
+	end
+	skynet.error(string.format("register %d names : %.2f ms", ROOM * NAME, elapsed(start)))
+
+	start = skynet.hpc()
+	for i, addr in ipairs(rooms) do
+		for j = 1, NAME do
+			assert(skynet.localname(string.format(".room%d_%d", i, j)) == addr)
+		end
+	end
+	assert(skynet.localname ".room_none" == nil)
+	skynet.error(string.format("query %d names : %.2f ms", ROOM * NAME, elapsed(start)))
+
+	start = skynet.hpc()
+	for i = 1, ROOM, 2 do
+		skynet.kill(rooms[i])
+	end
+	skynet.error(string.format("retire %d services : %.2f ms", ROOM // 2, elapsed(start)))
+
+	for i, addr in ipairs(rooms) do
+		for j = 1, NAME do
+			local name = string.format(".room%d_%d", i, j)
+			if i % 2 == 1 then
+				assert(skynet.localname(name) == nil)
+			else
+				assert(skynet.localname(name) == addr)
+			end
+		end
+	end
+	-- a retired name can be registered again
+	skynet.name(".room1_1", rooms[2])
+	assert(skynet.localname ".room1_1" == rooms[2])
+	skynet.call(".room1_1", "lua")
+
+	for i = 2, ROOM, 2 do
+		skynet.kill(rooms[i])
+	end
+	skynet.error "name test OK"
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,73 @@
+-- newservice throughput : launch a trivial service ROUND times one by one (latency), then PARALLEL at a time (throughput),
+-- then bursts of BURST services with idle time between them (a login storm the prewarmed pool can take).
+-- Set snlua_pool in the config to compare with the prewarmed state pool.
+local skynet = require "skynet"
+require "skynet.manager"	-- skynet.kill
+
+local mode = ...
+
+if mode == "child" then
+
+skynet.start(function() end)
+
+else
+
+local ROUND = 1000
+local PARALLEL = 16
+local BURST = 50
+
+local function launch(n)
+	local addr = {}
+	for i = 1, n do
+		addr[i] = skynet.newservice(SERVICE_NAME, "child")
+	end
+	return addr
+end
+
+local function kill(list)
+	for _, addr in ipairs(list) do
+		skynet.kill(addr)
+	end
+end
+
+skynet.start(function()
+	kill(launch(100))	-- warm up the code cache
+	collectgarbage "collect"
+
+	local start = skynet.hpc()
+	local list = launch(ROUND)
+	local ti = skynet.hpc() - start
+	kill(list)
+	skynet.error(string.format("newservice one by one : %d services %.2fms, %.1fus each", ROUND, ti / 1e6, ti / ROUND / 1e3))
+
+	list = {}
+	local n = ROUND // PARALLEL
+	start = skynet.hpc()
+	local reqs = skynet.request()
+	for i = 1, PARALLEL do
+		reqs:add { skynet.self(), "lua", n }
+	end
+	skynet.dispatch("lua", function(_,_, n)
+		skynet.ret(skynet.pack(launch(n)))
+	end)
+	for _, resp in reqs:select() do
+		table.move(resp[1], 1, n, #list + 1, list)
+	end
+	ti = skynet.hpc() - start
+	kill(list)
+	skynet.error(string.format("newservice %d in parallel : %d services %.2fms, %.0f per second (snlua_pool = %s, thread = %s)",
+		PARALLEL, #list, ti / 1e6, #list / ti * 1e9, skynet.getenv "snlua_pool", skynet.getenv "thread"))
+
+	ti = 0
+	for i = 1, ROUND // BURST do
+		skynet.sleep(10)	-- idle, the prewarm thread fills the pool
+		start = skynet.hpc()
+		list = launch(BURST)
+		ti = ti + skynet.hpc() - start
+		kill(list)
+	end
+	skynet.error(string.format("newservice in bursts of %d : %d services %.2fms, %.1fus each", BURST, ROUND, ti / 1e6, ti / ROUND / 1e3))
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,117 @@
+-- Sampling profiler : profile a busy service through the debug protocol (the same as `profile address` in debug console),
+-- check the hot function dominates the collapsed stacks, and measure the overhead of the count hook.
+-- A hook set by debug.sethook must survive the sampling.
+local skynet = require "skynet"
+
+local mode = ...
+
+if mode == "worker" then
+
+local profile = require "skynet.profile"
+
+local function cold(n)
+	local s = 0
+	for i = 1, n do
+		s = s + i
+	end
+	return s
+end
+
+local function hot(n)
+	local t = {}
+	for i = 1, n do
+		t[i % 64 + 1] = tostring(i)
+	end
+	return cold(n // 10)
+end
+
+local function work()
+	return hot(100000) + cold(10000)
+end
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd, hz)
+		if cmd == "work" then
+			skynet.ret(skynet.pack(work()))
+		elseif cmd == "bench" then
+			if hz then
+				profile.sample_start(hz)
+			end
+			local start = skynet.hpc()
+			for i = 1, 10 do
+				work()
+			end
+			local ti = skynet.hpc() - start
+			local samples = 0
+			if hz then
+				samples = select(2, profile.sample_stop())
+			end
+			skynet.ret(skynet.pack(ti, samples))
+		elseif cmd == "hook" then
+			local count = 0
+			local function hook()
+				count = count + 1
+			end
+			debug.sethook(hook, "", 1000)
+			profile.sample_start(1000)
+			skynet.sleep(0)	-- resume this coroutine while sampling
+			work()
+			profile.sample_stop()
+			local keep = debug.gethook() == hook
+			debug.sethook()
+			skynet.ret(skynet.pack(keep, count))
+		end
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local worker = skynet.newservice(SERVICE_NAME, "worker")
+	local stacks, samples
+	skynet.fork(function()
+		stacks, samples = skynet.call(worker, "debug", "PROFILE", 1, 1000)
+	end)
+	while not stacks do
+		skynet.call(worker, "lua", "work")
+	end
+	local hot, cold, total = 0, 0, 0
+	for stack, n in stacks:gmatch "(%S+) (%d+)\n" do
+		n = tonumber(n)
+		total = total + n
+		local leaf = stack:match "[^;]*$"
+		if leaf:find "^hot@" or leaf:find "^%[C%]tostring" then
+			hot = hot + n
+		elseif leaf:find "^cold@" then
+			cold = cold + n
+		end
+	end
+	assert(total == samples)
+	skynet.error(string.format("%d samples, %d stacks, hot %d, cold %d", samples, select(2, stacks:gsub("\n", "")), hot, cold))
+	skynet.error("top stack : " .. stacks:match "[^\n]*")
+	assert(hot > cold)
+
+	local keep, count = skynet.call(worker, "lua", "hook")
+	assert(keep and count > 0, "the hook of debug.sethook is replaced")
+
+	-- the best of 5 rounds, run alternately to reduce the noise
+	local HZ = { false, 100, 1000, 10000 }
+	local best, samples = {}, {}
+	for round = 1, 5 do
+		for i, hz in ipairs(HZ) do
+			local ti, n = skynet.call(worker, "lua", "bench", hz or nil)
+			if not best[i] or ti < best[i] then
+				best[i], samples[i] = ti, n
+			end
+		end
+	end
+	local base = best[1]
+	skynet.error(string.format("no profile : %.2fms", base / 1e6))
+	for i = 2, #HZ do
+		skynet.error(string.format("%5d hz : %.2fms, %d samples, overhead %.1f%%",
+			HZ[i], best[i] / 1e6, samples[i], (best[i] - base) * 100 / base))
+	end
+	skynet.exit()
+end)
+
+end
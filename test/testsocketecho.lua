@@ -0,0 +1,220 @@
+-- Loopback echo benchmark : CONNECTION tcp connections bounce a small message for DURATION seconds.
+-- Run it against different builds of the socket layer to compare their throughput and syscalls.
+-- Both sides handle the raw socket messages without coroutines : push them into a socket buffer
+-- and send the string back, as socket.read and socket.write do, so most of the time is spent
+-- in the socket thread, the syscalls and the allocator.
+-- Both ends live in this process, so 10k connections need 20k fds : raise ulimit -n, or the benchmark
+-- runs with as many connections as the fd limit allows.
+local skynet = require "skynet"
+local driver = require "skynet.socketdriver"
+
+local mode = ...
+
+local CONNECTION = 10000
+local CLIENT = 4
+local DURATION = 10
+local PORT = 8101
+local MESSAGE = string.rep("x", 32)
+local CONNECTING = 64	-- keep the listen backlog short
+
+-- read skynet_socket.h for these macro
+local SOCKET_DATA = 1
+local SOCKET_CONNECT = 2
+local SOCKET_ACCEPT = 4
+local SOCKET_ERROR = 5
+
+local pool = {}	-- the buffer node pool of lua-socket, see socket.lua
+
+if mode == "server" then
+
+skynet.start(function()
+	local buffer = {}
+	local listen = driver.listen("127.0.0.1", PORT, 1024)
+	skynet.register_protocol {
+		name = "socket",
+		id = skynet.PTYPE_SOCKET,
+		unpack = driver.unpack,
+		dispatch = function(_, _, t, id, sz, msg)
+			if t == SOCKET_DATA then
+				local b = buffer[id]
+				driver.push(b, pool, msg, sz)
+				driver.send(id, driver.readall(b, pool))
+			elseif t == SOCKET_ACCEPT then
+				buffer[sz] = driver.buffer()
+				driver.start(sz)	-- sz is the new id
+			elseif t == SOCKET_ERROR and id == listen then
+				skynet.error("listen error", msg)
+			end
+		end
+	}
+	driver.start(listen)
+	skynet.dispatch("lua", function()
+		skynet.ret()
+	end)
+end)
+
+elseif mode == "client" then
+
+local conn = {}
+local buffer = {}
+local count = 0
+local connected = 0
+local connecting = 0
+local waiting
+local running
+
+skynet.start(function()
+	skynet.register_protocol {
+		name = "socket",
+		id = skynet.PTYPE_SOCKET,
+		unpack = driver.unpack,
+		dispatch = function(_, _, t, id, sz, msg)
+			if t == SOCKET_DATA then
+				local b = buffer[id]
+				driver.push(b, pool, msg, sz)
+				local str = driver.readall(b, pool)
+				if running then
+					count = count + 1
+					driver.send(id, str)
+				end
+			elseif t == SOCKET_CONNECT or t == SOCKET_ERROR then
+				if conn[id] == false then
+					connecting = connecting - 1
+					if t == SOCKET_CONNECT then
+						conn[id] = true
+						buffer[id] = driver.buffer()
+						connected = connected + 1
+					else
+						conn[id] = nil
+					end
+					if waiting then
+						skynet.wakeup(waiting)
+					end
+				end
+			end
+		end
+	}
+	skynet.dispatch("lua", function(_,_, cmd, arg)
+		if cmd == "open" then
+			waiting = coroutine.running()
+			for i = 1, arg do
+				while connecting >= CONNECTING do
+					skynet.wait(waiting)
+				end
+				conn[driver.connect("127.0.0.1", PORT)] = false
+				connecting = connecting + 1
+			end
+			while connecting > 0 do
+				skynet.wait(waiting)
+			end
+			waiting = nil
+			skynet.ret(skynet.pack(connected))
+		elseif cmd == "run" then
+			running = true
+			for id in pairs(conn) do
+				driver.send(id, MESSAGE)
+			end
+			skynet.ret()
+		elseif cmd == "count" then
+			skynet.ret(skynet.pack(count))
+		elseif cmd == "stop" then
+			running = false
+			for id in pairs(conn) do
+				driver.close(id)
+			end
+			skynet.ret()
+		end
+	end)
+end)
+
+else
+
+local function fdlimit()
+	local f = io.open "/proc/self/limits"
+	if f then
+		local n = f:read "a":match "Max open files%s+(%d+)"
+		f:close()
+		return tonumber(n)
+	end
+end
+
+local function procstat()
+	local stat = {}
+	local f = io.open "/proc/self/io"
+	if f then
+		for k, v in f:read "a":gmatch "(%w+): (%d+)" do
+			stat[k] = tonumber(v)
+		end
+		f:close()
+	end
+	f = io.open "/proc/self/stat"
+	if f then
+		local fields = {}
+		for v in f:read "a":match "%) (.*)":gmatch "%S+" do
+			fields[#fields+1] = v
+		end
+		f:close()
+		stat.cpu = (tonumber(fields[12]) + tonumber(fields[13])) * 10	-- in ms, assume 100 ticks per second
+	end
+	return stat
+end
+
+skynet.start(function()
+	local server = skynet.newservice(SERVICE_NAME, "server")
+	skynet.call(server, "lua")
+	local clients = {}
+	local opened = 0
+	for i = 1, CLIENT do
+		clients[i] = skynet.newservice(SERVICE_NAME, "client")
+	end
+	local connection = CONNECTION
+	local limit = fdlimit()
+	-- the accepted side needs as many fds as the clients, the listen socket must never hit EMFILE
+	if limit and limit < connection * 2 + 256 then
+		connection = (limit - 256) // 2
+		skynet.error(string.format("open files limit is %d, use %d connections", limit, connection))
+	end
+	local per = connection // CLIENT
+	for i = 1, CLIENT do
+		opened = opened + skynet.call(clients[i], "lua", "open", per)
+	end
+	local function count()
+		local n = 0
+		for i = 1, CLIENT do
+			n = n + skynet.call(clients[i], "lua", "count")
+		end
+		return n
+	end
+	for i = 1, CLIENT do
+		skynet.call(clients[i], "lua", "run")
+	end
+	skynet.sleep(100)	-- warm up
+	local m0 = count()
+	local s0 = procstat()
+	local p0 = driver.recvpool()
+	local t0 = skynet.hpc()
+	skynet.sleep(DURATION * 100)
+	local s1 = procstat()
+	local p1 = driver.recvpool()
+	local elapsed = (skynet.hpc() - t0) / 1e9
+	local msg = count() - m0
+	for i = 1, CLIENT do
+		skynet.call(clients[i], "lua", "stop")
+	end
+	skynet.error(string.format("%d connections, %.0f round trips per second", opened, msg / elapsed))
+	if s0.syscr and s1.syscr then
+		local rw = (s1.syscr - s0.syscr) + (s1.syscw - s0.syscw)
+		skynet.error(string.format("read/write syscalls : %.0f per second, %.2f per round trip",
+			rw / elapsed, rw / math.max(msg, 1)))
+	end
+	local alloc = math.max(p1.alloc - p0.alloc, 1)
+	skynet.error(string.format("recv buffers : %d, reused %.1f%%, copied %.1f%%, recycled %d, cached %d bytes",
+		alloc, (p1.reuse - p0.reuse) * 100 / alloc, (p1.copy - p0.copy) * 100 / alloc, p1.recycle - p0.recycle, p1.cache))
+	if s0.cpu and s1.cpu then
+		skynet.error(string.format("cpu : %.1f ms per second, %.2f us per round trip",
+			(s1.cpu - s0.cpu) / elapsed, (s1.cpu - s0.cpu) * 1000 / math.max(msg, 1)))
+	end
+	skynet.exit()
+end)
+
+end
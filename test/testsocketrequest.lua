@@ -0,0 +1,138 @@
+-- Socket requests : FLOOD services send small requests (setopt) to the socket thread as fast as they can,
+-- so the request ring is full most of the time and spills to the overflow list.
+-- At the same time one connection sends numbered lines, the sends queued by the socket thread
+-- go through the same requests and must still arrive in order.
+-- Then ORDERED services each send numbered lines on their own connection, mixed with setopt requests,
+-- and close it. There are more of them than worker threads, so some are preempted between claiming
+-- a slot of the full ring and filling it, while their newer requests spill to the overflow list :
+-- every line must still arrive in order, before the close.
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+local driver = require "skynet.socketdriver"
+
+local mode, id = ...
+
+local FLOOD = 4
+local REQUEST = 500000
+local LINE = 100000
+local ORDERED = 16
+local ORDERED_LINE = 20000
+local PORT = 8104
+
+if mode == "flood" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		local t0 = skynet.hpc()
+		for i = 1, REQUEST do
+			driver.nodelay(tonumber(id))
+		end
+		skynet.ret(skynet.pack((skynet.hpc() - t0) / 1e9))
+	end)
+end)
+
+elseif mode == "ordered" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		local conn = assert(socket.open("127.0.0.1", PORT))
+		for i = 1, ORDERED_LINE do
+			socket.write(conn, id .. " " .. i .. "\n")
+			for j = 1, 8 do
+				driver.nodelay(conn)
+			end
+		end
+		socket.close(conn)
+		skynet.ret()
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local received = 0
+	local closed
+	local ordered = {}
+	local listen = socket.listen("127.0.0.1", PORT)
+	local accept = function(fd)
+		socket.start(fd)
+		for i = 1, LINE do
+			local line = socket.readline(fd)
+			assert(tonumber(line) == i, "out of order")
+			received = i
+		end
+		while socket.read(fd) do
+		end
+		socket.close(fd)
+		closed = true
+	end
+	socket.start(listen, function(fd)
+		skynet.fork(accept, fd)
+	end)
+	local conn = assert(socket.open("127.0.0.1", PORT))
+
+	local done = 0
+	local t0 = skynet.hpc()
+	for i = 1, FLOOD do
+		local s = skynet.newservice(SERVICE_NAME, "flood", conn)
+		skynet.fork(function()
+			skynet.call(s, "lua")
+			done = done + 1
+		end)
+	end
+	for i = 1, LINE do
+		socket.write(conn, i .. "\n")
+	end
+	while done < FLOOD or received < LINE do
+		skynet.sleep(1)
+	end
+	local elapsed = (skynet.hpc() - t0) / 1e9
+	skynet.error(string.format("%d requests in %.2fs, %.0f per second", FLOOD * REQUEST, elapsed, FLOOD * REQUEST / elapsed))
+	socket.close(conn)
+	while not closed do
+		skynet.sleep(1)
+	end
+
+	accept = function(fd)
+		socket.start(fd)
+		local n = 0
+		local s
+		while true do
+			local line = socket.readline(fd)
+			if not line then
+				break
+			end
+			local k, i = line:match "^(%d+) (%d+)$"
+			s = s or tonumber(k)
+			n = n + 1
+			assert(tonumber(k) == s and tonumber(i) == n, "out of order")
+		end
+		-- the close must not run before the queued sends
+		assert(n == ORDERED_LINE, "lost lines before close")
+		socket.close(fd)
+		ordered[s] = true
+	end
+	t0 = skynet.hpc()
+	local done = 0
+	for i = 1, ORDERED do
+		local s = skynet.newservice(SERVICE_NAME, "ordered", i)
+		skynet.fork(function()
+			skynet.call(s, "lua")
+			done = done + 1
+		end)
+	end
+	while done < ORDERED do
+		skynet.sleep(1)
+	end
+	for i = 1, ORDERED do
+		while not ordered[i] do
+			skynet.sleep(1)
+		end
+	end
+	skynet.error(string.format("%d ordered connections in %.2fs", ORDERED, (skynet.hpc() - t0) / 1e9))
+	socket.close(listen)
+	skynet.error("socket request test OK")
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,84 @@
+-- Socket threads : run it with socket_thread = 4 in the config.
+-- The socket id tells which socket thread owns it, the accepted connections of one listen socket
+-- and the connected ones should be spread over all the threads, and still echo correctly.
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local CONNECTION = 64
+local PORT = 8103
+
+local thread = tonumber(skynet.getenv "socket_thread") or 1
+
+local function shard(id)
+	local bits = 0
+	while (1 << bits) < thread do
+		bits = bits + 1
+	end
+	if bits == 0 then
+		return 0
+	end
+	return id >> (31 - bits)
+end
+
+local function histogram(ids)
+	local count = {}
+	for i = 0, thread - 1 do
+		count[i+1] = 0
+	end
+	for _, id in ipairs(ids) do
+		local s = shard(id)
+		count[s+1] = count[s+1] + 1
+	end
+	return count
+end
+
+skynet.start(function()
+	local accepted = {}
+	local closed = 0
+	local listen = socket.listen("127.0.0.1", PORT)
+	socket.start(listen, function(id)
+		accepted[#accepted+1] = id
+		skynet.fork(function()
+			socket.start(id)
+			while true do
+				local line = socket.readline(id)
+				if not line then
+					break
+				end
+				socket.write(id, line .. "\n")
+			end
+			socket.close(id)
+			closed = closed + 1
+		end)
+	end)
+
+	local connected = {}
+	for i = 1, CONNECTION do
+		connected[i] = assert(socket.open("127.0.0.1", PORT))
+	end
+	for i, id in ipairs(connected) do
+		socket.write(id, "ping " .. i .. "\n")
+	end
+	for i, id in ipairs(connected) do
+		assert(socket.readline(id) == "ping " .. i)
+	end
+	assert(#accepted == CONNECTION)
+	-- listen + both ends of every connection
+	assert(#socket.netstat() >= CONNECTION * 2 + 1)
+
+	local a = histogram(accepted)
+	local c = histogram(connected)
+	skynet.error(string.format("%d socket threads, accepted %s, connected %s", thread, table.concat(a, " "), table.concat(c, " ")))
+	for i = 1, thread do
+		assert(a[i] > 0 and c[i] > 0, "a socket thread owns no socket")
+	end
+	for _, id in ipairs(connected) do
+		socket.close(id)
+	end
+	while closed < CONNECTION do
+		skynet.sleep(1)
+	end
+	socket.close(listen)
+	skynet.error("socket thread test OK")
+	skynet.exit()
+end)
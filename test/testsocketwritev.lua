@@ -0,0 +1,102 @@
+-- Queued writes : the receiver doesn't read for a while, so PACKET small packets pile up in the
+-- write lists of the sender (socket.write to the high list, socket.lwrite to the low list).
+-- Then it reads them all and checks the order in each list. The netstat of the sender (write and wcount)
+-- tells how many write syscalls the socket thread used to send the queued packets.
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local PACKET = 200000
+local SIZE = 32
+local ROUND = 5
+local PORT = 8105
+
+local function procstat()
+	local stat = {}
+	local f = io.open "/proc/self/io"
+	if f then
+		for k, v in f:read "a":gmatch "(%w+): (%d+)" do
+			stat[k] = tonumber(v)
+		end
+		f:close()
+	end
+	return stat
+end
+
+local function packet(tag, n)
+	local s = string.format("%s%07d", tag, n)
+	return s .. string.rep(".", SIZE - #s)
+end
+
+local function netstat(id)
+	for _, info in ipairs(socket.netstat()) do
+		if info.id == id then
+			return info
+		end
+	end
+end
+
+skynet.start(function()
+	local accepted = {}
+	local listen = socket.listen("127.0.0.1", PORT)
+	socket.start(listen, function(id)
+		accepted[#accepted+1] = id
+	end)
+	local elapsed = 0
+	local syscw = 0
+	local bytes, wcount = 0, 0	-- sent by the socket thread from the write lists
+	for r = 1, ROUND do
+		-- a new connection each round, its accepted side isn't started until the packets are queued
+		local conn = assert(socket.open("127.0.0.1", PORT))
+		socket.warning(conn, function() end)	-- the write lists are meant to be large
+		while not accepted[r] do
+			skynet.sleep(1)
+		end
+		local id = accepted[r]
+		for i = 1, PACKET do
+			if i % 2 == 0 then
+				socket.write(conn, packet("H", i // 2))
+			else
+				socket.lwrite(conn, packet("L", i // 2 + 1))
+			end
+		end
+		skynet.sleep(10)	-- let the socket thread fill the kernel buffer, the rest stay in the write lists
+		local n0 = netstat(conn)
+		local s0 = procstat()
+		local t0 = skynet.hpc()
+		socket.start(id)
+		local h, l = 0, 0
+		for i = 1, PACKET do
+			local p = assert(socket.read(id, SIZE))
+			local tag, n = p:match "^(%u)(%d+)%.*$"
+			n = tonumber(n)
+			if tag == "H" then
+				h = h + 1
+				assert(n == h, "high list out of order")
+			else
+				l = l + 1
+				assert(tag == "L" and n == l, "low list out of order")
+			end
+		end
+		elapsed = elapsed + (skynet.hpc() - t0)
+		local s1 = procstat()
+		if s0.syscw and s1.syscw then
+			syscw = syscw + s1.syscw - s0.syscw
+		end
+		local n1 = netstat(conn)
+		bytes = bytes + n1.write - n0.write
+		wcount = wcount + n1.wcount - n0.wcount
+		socket.close(id)
+		socket.close(conn)
+	end
+	elapsed = elapsed / 1e9
+	skynet.error(string.format("%d packets of %d bytes in %.2fs, %.0f packets per second",
+		PACKET * ROUND, SIZE, elapsed, PACKET * ROUND / elapsed))
+	skynet.error(string.format("queued : %d packets in %d write calls, %.1f packets per call",
+		bytes // SIZE, wcount, bytes / SIZE / math.max(wcount, 1)))
+	if syscw > 0 then
+		skynet.error(string.format("write syscalls of the process while draining : %d", syscw))
+	end
+	socket.close(listen)
+	skynet.error("socket writev test OK")
+	skynet.exit()
+end)
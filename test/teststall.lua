@@ -0,0 +1,51 @@
+-- Stall detector : run it with stall_threshold = 50 in the config.
+-- A service busy loops for 300ms in lua, the monitor should record the stall with its traceback, and the service goes on.
+local skynet = require "skynet"
+require "skynet.manager"	-- skynet.kill
+local core = require "skynet.core"
+
+local mode = ...
+
+if mode == "slave" then
+
+local function busy_loop(ns)
+	local t = skynet.hpc() + ns
+	while skynet.hpc() < t do end
+end
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, ms)
+		busy_loop(ms * 1000000)
+		skynet.ret(skynet.pack "done")
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local threshold = tonumber(skynet.getenv "stall_threshold") or 0
+	assert(threshold > 0, "set stall_threshold in config")
+	local slave = skynet.newservice(SERVICE_NAME, "slave")
+	assert(skynet.call(slave, "lua", 300) == "done")	-- not interrupted
+	skynet.sleep(50)	-- wait for the monitor
+	local found
+	for _, r in ipairs(core.stall()) do
+		skynet.error(string.format("stall :%08x -> :%08x %dms\n%s", r.source, r.destination, r.duration, r.trace))
+		if r.destination == slave then
+			found = r
+		end
+	end
+	assert(found, "stall not found")
+	assert(found.duration >= threshold)
+	assert(found.trace:find "busy_loop", "no traceback")
+	-- a short message is not a stall
+	local n = #core.stall()
+	skynet.call(slave, "lua", threshold // 5)
+	skynet.sleep(50)
+	assert(#core.stall() == n)
+	skynet.error "stall OK"
+	skynet.kill(slave)
+	skynet.exit()
+end)
+
+end
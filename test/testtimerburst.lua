@@ -0,0 +1,77 @@
+-- Timer burst : SERVICE services each set ROUND_TIMERS timeouts expiring on the same tick (50k in total).
+-- The members count the expired timers as unknown responses (no coroutine per timer), so the result shows
+-- how long the timer thread takes to deliver the burst, not the cost of the lua side.
+local skynet = require "skynet"
+require "skynet.manager"	-- skynet.kill
+local c = require "skynet.core"
+
+local mode = ...
+
+local SERVICE = 100
+local ROUND_TIMERS = 500
+local DELAY = 50
+
+if mode == "member" then
+
+local main
+local first, last
+local n = 0
+
+-- the timeouts are set by the raw TIMEOUT command, so their responses come here
+local function count_timeout()
+	local now = skynet.hpc()
+	n = n + 1
+	if n == 1 then
+		first = now
+	end
+	if n == ROUND_TIMERS then
+		last = now
+		skynet.send(main, "lua", first, last)
+	end
+end
+
+skynet.start(function()
+	skynet.dispatch_unknown_response(count_timeout)
+	skynet.dispatch("lua", function(_, source, deadline)
+		main = source
+		n = 0
+		local ti = deadline - skynet.now()
+		for i = 1, ROUND_TIMERS do
+			c.intcommand("TIMEOUT", ti)
+		end
+		skynet.ret()
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local members = {}
+	for i = 1, SERVICE do
+		members[i] = skynet.newservice(SERVICE_NAME, "member")
+	end
+	local co = coroutine.running()
+	local first, last = math.huge, 0
+	local done = 0
+	skynet.dispatch("lua", function(_,_, f, l)
+		first = math.min(first, f)
+		last = math.max(last, l)
+		done = done + 1
+		if done == SERVICE then
+			skynet.wakeup(co)
+		end
+	end)
+	local deadline = skynet.now() + DELAY
+	for _, addr in ipairs(members) do
+		skynet.call(addr, "lua", deadline)
+	end
+	skynet.wait(co)
+	skynet.error(string.format("%d timers in one tick to %d services : delivered in %.2fms",
+		SERVICE * ROUND_TIMERS, SERVICE, (last - first) / 1e6))
+	for _, addr in ipairs(members) do
+		skynet.kill(addr)
+	end
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,64 @@
+-- Timer contention : SERVICE services insert ROUND_TIMERS timeouts each at the same time, then cancel them all.
+-- Run it with thread = 32 in the config, so that every member has its own worker and they all hit timer_add together.
+-- The timeouts are set by the raw TIMEOUT command, no coroutine is created per timer.
+local skynet = require "skynet"
+require "skynet.manager"	-- skynet.kill
+local c = require "skynet.core"
+
+local mode = ...
+
+local SERVICE = 32
+local ROUND_TIMERS = 20000
+
+if mode == "member" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		local session = {}
+		local start = skynet.hpc()
+		for i = 1, ROUND_TIMERS do
+			session[i] = c.intcommand("TIMEOUT", 1000 + i % 1000)
+		end
+		local added = skynet.hpc()
+		local cancelled = 0
+		for i = 1, ROUND_TIMERS do
+			if c.intcommand("CANCEL", session[i]) then
+				cancelled = cancelled + 1
+			end
+		end
+		skynet.retpack(start, added, skynet.hpc(), cancelled)
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local members = {}
+	for i = 1, SERVICE do
+		members[i] = skynet.newservice(SERVICE_NAME, "member")
+	end
+	local reqs = skynet.request()
+	for _, addr in ipairs(members) do
+		reqs:add { addr, "lua" }
+	end
+	local first, added, last = math.huge, 0, 0
+	local slowest = 0
+	for _, resp in reqs:select() do
+		local s, a, e, cancelled = table.unpack(resp)
+		assert(cancelled == ROUND_TIMERS)
+		first = math.min(first, s)
+		added = math.max(added, a)
+		last = math.max(last, e)
+		slowest = math.max(slowest, a - s)
+	end
+	local n = SERVICE * ROUND_TIMERS
+	skynet.error(string.format("%d services (%s threads) insert %d timers : %.2fms, %.0f per second, slowest member %.2fms",
+		SERVICE, skynet.getenv "thread", n, (added - first) / 1e6, n / (added - first) * 1e9, slowest / 1e6))
+	skynet.error(string.format("cancel %d timers : %.2fms", n, (last - added) / 1e6))
+	for _, addr in ipairs(members) do
+		skynet.kill(addr)
+	end
+	skynet.exit()
+end)
+
+end
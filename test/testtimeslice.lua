@@ -0,0 +1,98 @@
+-- Dispatch time slice : one bulk service per worker drains a flood of 20us messages while a light service answers pings.
+-- Run it with timeslice = 2000 and without timeslice in the config (thread = 8, the workers 4-7 of the
+-- static weight table drain a whole queue per visit) to compare the round trip of the pings.
+-- With timeslice, a visit of a bulk service lasts about timeslice microsec, so the pings must not wait much longer.
+local skynet = require "skynet"
+require "skynet.manager"	-- skynet.kill
+
+local mode = ...
+
+local FLOOD = 50000
+local COST = 20000	-- ns per bulk message
+local PING = 100
+
+if mode == "bulk" then
+
+local last = 0
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd)
+		if cmd == "work" then
+			local t = skynet.hpc() + COST
+			while skynet.hpc() < t do end
+			last = skynet.hpc()
+		else
+			assert(cmd == "last")
+			skynet.ret(skynet.pack(last))
+		end
+	end)
+end)
+
+elseif mode == "flood" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, bulk)
+		for i = 1, FLOOD do
+			skynet.send(bulk, "lua", "work")
+		end
+		skynet.ret()
+	end)
+end)
+
+elseif mode == "light" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function()
+		skynet.ret()
+	end)
+end)
+
+else
+
+skynet.start(function()
+	local thread = tonumber(skynet.getenv "thread")
+	local timeslice = tonumber(skynet.getenv "timeslice") or 0
+	local light = skynet.newservice(SERVICE_NAME, "light")
+	local bulk, flood = {}, {}
+	for i = 1, thread do
+		bulk[i] = skynet.newservice(SERVICE_NAME, "bulk")
+		flood[i] = skynet.newservice(SERVICE_NAME, "flood")
+	end
+	for i = 1, thread do
+		skynet.send(flood[i], "lua", bulk[i])
+	end
+	skynet.sleep(10)	-- let the floods start
+	local rtt = {}
+	for i = 1, PING do
+		local t = skynet.hpc()
+		skynet.call(light, "lua")
+		rtt[i] = (skynet.hpc() - t) / 1e6
+		skynet.sleep(1)
+	end
+	local finish = skynet.hpc()
+	local busy = 0	-- the bulk services still flooded after the pings
+	for i = 1, thread do
+		if skynet.call(bulk[i], "lua", "last") > finish then
+			busy = busy + 1
+		end
+	end
+	table.sort(rtt)
+	local function percent(p)
+		return rtt[math.max(1, math.floor(#rtt * p))]
+	end
+	skynet.error(string.format("timeslice = %d, %d threads : ping round trip (ms) p50 = %.2f p99 = %.2f max = %.2f, %d bulk services busy after the pings",
+		timeslice, thread, percent(0.5), percent(0.99), rtt[#rtt], busy))
+	assert(busy > 0, "the flood is too short")
+	if timeslice > 0 then
+		-- a draining worker would hold a bulk service for FLOOD * COST (1s), leave room for the os scheduler
+		assert(percent(0.99) < timeslice * 25 / 1000, "the light service waits behind the bulk services")
+	end
+	for i = 1, thread do
+		skynet.kill(bulk[i])
+		skynet.kill(flood[i])
+	end
+	skynet.kill(light)
+	skynet.exit()
+end)
+
+end
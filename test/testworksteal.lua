@@ -0,0 +1,94 @@
+-- Work stealing : one producer service floods CONSUMER services, so every consumer queue becomes runnable
+-- on the producer's worker and the other workers can only get them by stealing.
+-- Run it with worksteal = true and without it in the config to compare the throughput with the global queue.
+local skynet = require "skynet"
+
+local mode, total = ...
+
+local CONSUMER = 64
+
+-- the first field of /proc/thread-self/stat is the tid of the worker
+local function worker()
+	local f = io.open "/proc/thread-self/stat"
+	if not f then
+		return
+	end
+	local tid = f:read "n"
+	f:close()
+	return tid
+end
+
+if mode == "consumer" then
+
+local count = 0
+local workers = {}
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, cmd)
+		if cmd == "data" then
+			count = count + 1
+			if count % 100 == 1 then
+				local tid = worker()
+				if tid then
+					workers[tid] = true
+				end
+			end
+		else
+			assert(cmd == "result")
+			skynet.ret(skynet.pack(count, workers))
+			count = 0
+			workers = {}
+		end
+	end)
+end)
+
+elseif mode == "producer" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, consumer, n)
+		for i = 1, n do
+			for j = 1, #consumer do
+				skynet.send(consumer[j], "lua", "data")
+			end
+		end
+		skynet.ret()
+	end)
+end)
+
+else
+
+local N = tonumber(total) or 1000000
+
+skynet.start(function()
+	local thread = tonumber(skynet.getenv "thread")
+	local worksteal = skynet.getenv "worksteal" == "true"
+	local producer = skynet.newservice(SERVICE_NAME, "producer")
+	local consumer = {}
+	for i = 1, CONSUMER do
+		consumer[i] = skynet.newservice(SERVICE_NAME, "consumer")
+	end
+	local per = N // CONSUMER
+	local start = skynet.hpc()
+	skynet.call(producer, "lua", consumer, per)
+	local workers = {}
+	local nworker = 0
+	for i = 1, CONSUMER do
+		local count, w = skynet.call(consumer[i], "lua", "result")
+		assert(count == per, string.format("consumer %d got %d of %d messages", i, count, per))
+		for tid in pairs(w) do
+			if not workers[tid] then
+				workers[tid] = true
+				nworker = nworker + 1
+			end
+		end
+	end
+	local ti = (skynet.hpc() - start) / 1e9
+	skynet.error(string.format("worksteal = %s threads = %d messages = %d time = %.3fs %.0f msg/s, consumers ran on %d workers",
+		worksteal, thread, per * CONSUMER, ti, per * CONSUMER / ti, nworker))
+	if worksteal and thread > 1 and worker() then
+		assert(nworker > 1, "no consumer queue was stolen")
+	end
+	skynet.exit()
+end)
+
+end